@@ -0,0 +1,432 @@
+
+// Benchmarks for the simulation's hot paths. Every benchmark runs a fixed,
+// seeded workload a few times to warm up and then a number of timed
+// repetitions, and the results come out as CSV or JSON so runs can be compared
+// by machine. Built by the bench target; world_draw is only measured when the
+// build found SDL (BENCH_WITH_SDL). The indexed vision query is also checked
+// against the plain scan on every workload, and a mismatch fails the run.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+#include "nn_batch.h"
+#include "engine.h"
+#include "metrics.h"
+
+#ifdef BENCH_WITH_SDL
+#include "render.h"
+#endif
+
+namespace {
+
+struct options {
+  int warmup = 2;
+  int repetitions = 10;
+  uint64_t seed = 1;
+  bool json = false;
+  std::string filter;
+};
+
+struct result {
+  std::string name;
+  std::string params;
+  int repetitions;
+  long long ops;
+  double median_ns;
+  double min_ns;
+};
+
+options opts;
+std::vector<result> results;
+
+// Cleared when an optimized routine disagrees with its reference version.
+bool ok = true;
+
+// Keeps the compiler from throwing away work whose result we don't use.
+volatile uint64_t sink;
+
+// Time fn, which does ops operations per call, and record how long one
+// operation takes.
+void run(const std::string& name, const std::string& params, const long long ops,
+         const std::function<void()>& fn) {
+  if (!opts.filter.empty() && (name + "/" + params).find(opts.filter) == std::string::npos) {
+    return;
+  }
+
+  using clock = std::chrono::steady_clock;
+
+  for (int i = 0; i < opts.warmup; ++i) {
+    fn();
+  }
+
+  std::vector<double> ns;
+
+  for (int i = 0; i < opts.repetitions; ++i) {
+    const auto start = clock::now();
+    fn();
+    ns.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / ops);
+  }
+
+  std::sort(ns.begin(), ns.end());
+
+  results.push_back({ name, params, opts.repetitions, ops, ns[ns.size() / 2], ns.front() });
+
+  std::fprintf(stderr, "%-28s %-24s %10.2f ns/op\n", name.c_str(), params.c_str(), ns[ns.size() / 2]);
+}
+
+void print_results() {
+  if (opts.json) {
+    std::printf("[\n");
+
+    for (size_t i = 0; i < results.size(); ++i) {
+      const result& r = results[i];
+
+      std::printf("  {\"benchmark\": \"%s\", \"params\": \"%s\", \"repetitions\": %d, \"ops_per_repetition\": %lld, "
+                  "\"ns_per_op_median\": %.3f, \"ns_per_op_min\": %.3f, \"ops_per_second\": %.1f}%s\n",
+                  r.name.c_str(), r.params.c_str(), r.repetitions, r.ops, r.median_ns, r.min_ns,
+                  1e9 / r.median_ns, i + 1 < results.size() ? "," : "");
+    }
+
+    std::printf("]\n");
+  } else {
+    std::printf("benchmark,params,repetitions,ops_per_repetition,ns_per_op_median,ns_per_op_min,ops_per_second\n");
+
+    for (const result& r : results) {
+      std::printf("%s,%s,%d,%lld,%.3f,%.3f,%.1f\n", r.name.c_str(), r.params.c_str(), r.repetitions, r.ops,
+                  r.median_ns, r.min_ns, 1e9 / r.median_ns);
+    }
+  }
+}
+
+// A world where roughly per_mille tiles in every thousand hold fruit or a
+// cactus (half and half), or the usual randomize_world layout for 0.
+void make_world(world& w, const int per_mille, rng& rand) {
+  if (per_mille == 0) {
+    randomize_world(w, rand.next());
+    return;
+  }
+
+  w = world();
+
+  for (int y = 0; y < world_height; ++y) {
+    for (int x = 0; x < world_width; ++x) {
+      if ((int)rand.below(1000) < per_mille) {
+        world_putent(w, x, y, (worldent)(world_grass | ((rand.next() & 1) ? world_fruit : world_cactus)));
+      }
+    }
+  }
+}
+
+// Agents scattered over the world facing every which way.
+std::vector<agent> make_agents(const size_t n, const int vision_distance, rng& rand) {
+  std::vector<agent> agents(n);
+
+  for (auto& a : agents) {
+    a.x_pos = rand.below(world_width);
+    a.y_pos = rand.below(world_height);
+    a.facing = (agent::direction)rand.below(4);
+    a.vision_distance = vision_distance;
+    a.stamina = rand.below(a.max_stamina);
+    a.oxygen = rand.below(a.max_oxygen);
+    a.heat = rand.below(a.max_heat);
+    randomize_nn(a.nn, rand);
+  }
+
+  return agents;
+}
+
+void bench_world_access() {
+  rng rand(opts.seed);
+  std::unique_ptr<world> w(new world);
+  make_world(*w, 0, rand);
+
+  const int n = 1 << 20;
+  std::vector<int> xs(n), ys(n);
+  std::vector<uint8_t> ents(n);
+
+  for (int i = 0; i < n; ++i) {
+    xs[i] = (int)rand.below(3 * world_width) - world_width;
+    ys[i] = (int)rand.below(3 * world_height) - world_height;
+    ents[i] = world_grass | (rand.below(4) == 0 ? world_fruit : 0);
+  }
+
+  run("world_getent", "random", n, [&]() {
+    uint64_t total = 0;
+    for (int i = 0; i < n; ++i) {
+      total += world_getent(*w, xs[i], ys[i]);
+    }
+    sink = total;
+  });
+
+  run("world_getent", "sweep", world_width * world_height, [&]() {
+    uint64_t total = 0;
+    for (int x = 0; x < world_width; ++x) {
+      for (int y = 0; y < world_height; ++y) {
+        total += world_getent(*w, x, y);
+      }
+    }
+    sink = total;
+  });
+
+  run("world_putent", "random", n, [&]() {
+    for (int i = 0; i < n; ++i) {
+      world_putent(*w, xs[i], ys[i], (worldent)ents[i]);
+    }
+  });
+}
+
+void bench_vision() {
+  const size_t n = 4096;
+
+  for (const int per_mille : { 0, 10, 50, 200 }) {
+    rng rand(opts.seed);
+    std::unique_ptr<world> w(new world);
+    make_world(*w, per_mille, rand);
+
+    const std::string density = per_mille ? "density=" + std::to_string(per_mille) + "/1000" : "density=default";
+
+    for (const int distance : { 5, 10, 20, 40 }) {
+      const std::vector<agent> agents = make_agents(n, distance, rand);
+      const std::string params = density + " distance=" + std::to_string(distance);
+
+      for (size_t i = 0; i < n; ++i) {
+        const input_t indexed = calculate_vision_input(*w, agents[i]);
+        const input_t scanned = calculate_vision_input_scan(*w, agents[i]);
+
+        if (indexed != scanned) {
+          std::fprintf(stderr, "calculate_vision_input MISMATCH (%s) at agent %zu: %#llx != %#llx\n",
+                       params.c_str(), i, (unsigned long long)indexed, (unsigned long long)scanned);
+          ok = false;
+          break;
+        }
+      }
+
+      run("calculate_vision_input", params, n, [&]() {
+        uint64_t total = 0;
+        for (const auto& a : agents) {
+          total += calculate_vision_input(*w, a);
+        }
+        sink = total;
+      });
+
+      run("calculate_vision_input_scan", params, n, [&]() {
+        uint64_t total = 0;
+        for (const auto& a : agents) {
+          total += calculate_vision_input_scan(*w, a);
+        }
+        sink = total;
+      });
+    }
+  }
+}
+
+void bench_senses_and_nn() {
+  const size_t n = 4096;
+
+  rng rand(opts.seed);
+  std::unique_ptr<world> w(new world);
+  make_world(*w, 0, rand);
+
+  std::vector<agent> agents = make_agents(n, 20, rand);
+  std::vector<input_t> inputs(n);
+
+  for (auto& in : inputs) {
+    in = rand.next();
+  }
+
+  run("calculate_senses", "", n, [&]() {
+    uint64_t total = 0;
+    for (const auto& a : agents) {
+      total += calculate_senses(*w, a);
+    }
+    sink = total;
+  });
+
+  run("evaluate_nn", "", n, [&]() {
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+      total += evaluate_nn(agents[i].nn, inputs[i], agents[i].rand);
+    }
+    sink = total;
+  });
+
+  perceptron_population pop;
+  population_resize(pop, n);
+
+  for (size_t i = 0; i < n; ++i) {
+    population_store(pop, i, agents[i].nn);
+  }
+
+  std::vector<uint16_t> outputs(n);
+
+  for (const nn_batch_isa isa : { nn_batch_isa::scalar, nn_batch_isa::avx2, nn_batch_isa::avx512 }) {
+    if (!nn_batch_isa_supported(isa)) {
+      continue;
+    }
+
+    run("evaluate_nn_batch", nn_batch_isa_name(isa), n, [&]() {
+      evaluate_nn_batch(isa, pop, inputs.data(), outputs.data(), 0, n);
+      sink = outputs[n / 2];
+    });
+  }
+
+  std::vector<unsigned int> masks(n);
+
+  for (auto& m : masks) {
+    // Non-empty masks of the five actions, like the net's output.
+    m = 1 + rand.below(31);
+  }
+
+  run("choose_random_action", "", n, [&]() {
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+      total += choose_random_action(masks[i], rand);
+    }
+    sink = total;
+  });
+}
+
+void bench_tick() {
+  std::unique_ptr<simulation> sim(new simulation);
+  sim->rand = rng(opts.seed);
+  simulation_reset(*sim);
+
+  statistics stats;
+  const int ticks = 100000;
+
+  // Includes starting a new life whenever the agent dies, as the viewer does.
+  run("simulation_tick", "think+runtick", ticks, [&]() {
+    for (int t = 0; t < ticks; ++t) {
+      simulation_tick(stats, *sim, simulation_think(*sim));
+    }
+  });
+
+  thread_pool pool(1);
+  engine e;
+  engine_init(e, 256, pool, opts.seed);
+
+  const int engine_ticks = 200;
+
+  run("engine_run", "instances=256 threads=1", 256 * engine_ticks, [&]() {
+    engine_run(e, pool, engine_ticks);
+  });
+
+  // The same with the profiler on, draining its rings as headless does; the
+  // difference from the above is the profiler's overhead.
+  profiler prof;
+  profiler_init(prof, pool.size());
+  metrics m;
+  metrics_begin(m, engine_statistics(e));
+  e.prof = &prof;
+
+  run("engine_run", "instances=256 threads=1 profiled", 256 * engine_ticks, [&]() {
+    engine_run(e, pool, engine_ticks);
+    metrics_collect(m, prof);
+  });
+
+  e.prof = nullptr;
+}
+
+#ifdef BENCH_WITH_SDL
+void bench_draw() {
+  using surface_ptr = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+  using render_ptr = std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)>;
+
+  surface_ptr surface { SDL_CreateRGBSurfaceWithFormat(0, 1024, 1024, 32, SDL_PIXELFORMAT_ARGB8888), SDL_FreeSurface };
+  render_ptr renderer { surface ? SDL_CreateSoftwareRenderer(surface.get()) : nullptr, SDL_DestroyRenderer };
+
+  world_renderer wr;
+
+  if (!renderer || !world_renderer_init(wr, renderer.get())) {
+    std::fprintf(stderr, "skipping world_draw: %s\n", SDL_GetError());
+    return;
+  }
+
+  rng rand(opts.seed);
+  std::unique_ptr<simulation> sim(new simulation);
+  sim->rand = rng(opts.seed);
+  simulation_reset(*sim);
+
+  const int frames = 20;
+
+  run("world_draw", "full upload", frames, [&]() {
+    for (int f = 0; f < frames; ++f) {
+      wr.stale = true;
+      world_draw(wr, sim->a, sim->w, renderer.get());
+    }
+  });
+
+  run("world_draw", "one tile changed", frames, [&]() {
+    for (int f = 0; f < frames; ++f) {
+      const int x = rand.below(world_width), y = rand.below(world_height);
+      world_putent(sim->w, x, y, (worldent)(world_getent(sim->w, x, y) ^ world_fruit));
+      world_draw(wr, sim->a, sim->w, renderer.get());
+    }
+  });
+}
+#endif
+
+void usage(const char* prog) {
+  std::cout << "usage: " << prog << " [--format csv|json] [--repetitions N] [--warmup N] [--seed N] [--filter TEXT]\n"
+            << "  results go to stdout, progress to stderr\n";
+}
+
+bool parse_options(int argc, char* args[]) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = args[i];
+
+    if (i + 1 >= argc) {
+      return false;
+    }
+
+    const char* value = args[++i];
+
+    if (!strcmp(arg, "--format")) {
+      if (strcmp(value, "csv") && strcmp(value, "json")) {
+        return false;
+      }
+      opts.json = !strcmp(value, "json");
+    } else if (!strcmp(arg, "--repetitions")) {
+      opts.repetitions = std::max(1, std::atoi(value));
+    } else if (!strcmp(arg, "--warmup")) {
+      opts.warmup = std::max(0, std::atoi(value));
+    } else if (!strcmp(arg, "--seed")) {
+      opts.seed = std::strtoull(value, nullptr, 10);
+    } else if (!strcmp(arg, "--filter")) {
+      opts.filter = value;
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}
+
+int main(int argc, char* args[]) {
+  if (!parse_options(argc, args)) {
+    usage(args[0]);
+    return 1;
+  }
+
+  bench_world_access();
+  bench_vision();
+  bench_senses_and_nn();
+  bench_tick();
+#ifdef BENCH_WITH_SDL
+  bench_draw();
+#endif
+
+  print_results();
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+// Steps many independent simulations at once on a thread pool. Each instance
+// is its own world with its own agent; nothing is shared between them except
+// the statistics, which every pool participant accumulates privately and which
+// are merged when asked for.
+
+#include <climits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sim.h"
+#include "nn_batch.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+
+// Follows one instance through its lives and saves an action log of the
+// longest one seen so far.
+struct life_recorder {
+  size_t instance = 0;
+  std::string path;
+
+  // The life going on now, and the longest one that has ended.
+  action_log life;
+  action_log longest;
+
+  // longest changed and is still to be written out; it is, once the pool is
+  // done with the ticks at hand.
+  bool pending = false;
+  bool written = false;
+};
+
+// The engine's instances: either its own, or the ones in a snapshot it has
+// mapped, which it then steps in place.
+class simulation_array {
+public:
+  void assign(const size_t count) {
+    mapped.reset();
+    owned.assign(count, simulation());
+    first = owned.data();
+    length = count;
+  }
+
+  void alias(std::unique_ptr<snapshot_map> snap) {
+    owned.clear();
+    owned.shrink_to_fit();
+    mapped = std::move(snap);
+    first = mapped->simulations();
+    length = mapped->instances();
+  }
+
+  size_t size() const { return length; }
+  const simulation* data() const { return first; }
+
+  simulation& operator[](const size_t i) { return first[i]; }
+  const simulation& operator[](const size_t i) const { return first[i]; }
+
+private:
+  std::vector<simulation> owned;
+  std::unique_ptr<snapshot_map> mapped;
+
+  simulation* first = nullptr;
+  size_t length = 0;
+};
+
+struct engine {
+  simulation_array sims;
+
+  // One block of statistics per pool participant.
+  std::vector<participant_statistics> per_thread;
+
+  // Every instance's net, laid out for the batched evaluator, plus the
+  // inputs and outputs it works on. Kept in sync with sims[i].a.nn.
+  perceptron_population population;
+  std::vector<input_t> inputs;
+  std::vector<uint16_t> outputs;
+
+  // How many instances make up one unit of work handed to the pool. A
+  // multiple of perceptron_population::lanes so batches line up with vectors.
+  size_t grain = 64;
+
+  // Ticks every instance has run so far.
+  uint64_t tick = 0;
+
+  life_recorder* recorder = nullptr;
+
+  // When set, a sample of the instance-ticks are timed phase by phase.
+  profiler* prof = nullptr;
+};
+
+// Size everything but the instances themselves.
+inline void engine_allocate(engine& e, const size_t instances, const thread_pool& pool) {
+  e.per_thread.assign(pool.size(), participant_statistics());
+  e.tick = 0;
+
+  population_resize(e.population, instances);
+  e.inputs.assign(e.population.and_mask[0].size(), 0);
+  e.outputs.assign(e.population.and_mask[0].size(), 0);
+}
+
+// Set up the given number of instances. Instance i draws its randomness from
+// stream i of the master seed, so a run is reproducible whatever the number of
+// threads.
+inline void engine_init(engine& e, const size_t instances, const thread_pool& pool,
+                        const uint64_t seed) {
+  e.sims.assign(instances);
+  engine_allocate(e, instances, pool);
+
+  for (size_t i = 0; i < instances; ++i) {
+    e.sims[i].rand = rng(rng_stream_seed(seed, i));
+    simulation_reset(e.sims[i]);
+    population_store(e.population, i, e.sims[i].a.nn);
+  }
+}
+
+// Pick up a run where a snapshot left it. The engine takes the mapping over
+// and runs on the snapshot's simulations where they lie; only the nets are
+// copied out, into the batched evaluator's layout.
+inline void engine_load(engine& e, std::unique_ptr<snapshot_map> snap, const thread_pool& pool) {
+  const statistics stats = snap->stats();
+  const uint64_t tick = snap->tick();
+
+  e.sims.alias(std::move(snap));
+  engine_allocate(e, e.sims.size(), pool);
+
+  for (size_t i = 0; i < e.sims.size(); ++i) {
+    population_store(e.population, i, e.sims[i].a.nn);
+  }
+
+  e.per_thread[0].stats = stats;
+  e.tick = tick;
+}
+
+// Start recording the given instance's lives, from where it is now.
+inline void engine_record(engine& e, life_recorder& recorder) {
+  const simulation& sim = e.sims[recorder.instance];
+
+  action_log_begin(recorder.life, sim.w, sim.a);
+  e.recorder = &recorder;
+}
+
+// The recorded instance just died and started over: keep its life if it is
+// the longest yet, and begin recording the new one.
+inline void life_recorder_died(life_recorder& recorder, const simulation& sim) {
+  if (recorder.life.ticks > recorder.longest.ticks) {
+    std::swap(recorder.life, recorder.longest);
+    recorder.pending = true;
+  }
+
+  action_log_begin(recorder.life, sim.w, sim.a);
+}
+
+inline void life_recorder_flush(life_recorder& recorder) {
+  if (recorder.pending) {
+    recorder.written = action_log_write(recorder.path, recorder.longest);
+    recorder.pending = false;
+  }
+}
+
+// Stop recording. The life still going on counts too, if it's the longest.
+// Returns whether a life was written out.
+inline bool engine_end_recording(engine& e) {
+  if (!e.recorder) {
+    return false;
+  }
+
+  life_recorder& recorder = *e.recorder;
+  e.recorder = nullptr;
+
+  if (recorder.life.ticks > recorder.longest.ticks) {
+    std::swap(recorder.life, recorder.longest);
+    recorder.pending = true;
+  }
+
+  life_recorder_flush(recorder);
+
+  return recorder.written;
+}
+
+// The samples one timed instance-tick pushes: senses, vision and the four
+// parts of runtick.
+const size_t engine_samples_per_tick = 6;
+
+// The most ticks engine_run can be asked for at once without a profile ring
+// filling up before it is drained, even if one thread ends up running every
+// chunk.
+inline int engine_profile_ticks(const engine& e) {
+  if (!e.prof) {
+    return INT_MAX;
+  }
+
+  const size_t n = e.sims.size();
+  const size_t per_tick = engine_samples_per_tick * ((n + e.prof->period - 1) / e.prof->period)
+                        + (n + e.grain - 1) / e.grain;
+
+  return (int)std::max<size_t>(1, profile_ring::capacity / std::max<size_t>(per_tick, 1));
+}
+
+// Advance every instance by the given number of ticks. With a profiler, keep
+// to engine_profile_ticks() between drains or samples are dropped.
+inline void engine_run(engine& e, thread_pool& pool, const int ticks) {
+  pool.parallel_for(e.sims.size(), e.grain, [&e, ticks](size_t begin, size_t end, unsigned participant) {
+    statistics& s = e.per_thread[participant].stats;
+
+    profile_probe thread_probe;
+    profile_probe* const timing = e.prof ? &thread_probe : nullptr;
+
+    if (timing) {
+      thread_probe.ring = e.prof->rings[participant].get();
+    }
+
+    // Step the chunk a tick at a time so that all of its nets can be
+    // evaluated together by the batched kernel.
+    for (int t = 0; t < ticks; ++t) {
+      const uint64_t tick = e.tick + t;
+
+      for (size_t i = begin; i < end; ++i) {
+        const simulation& sim = e.sims[i];
+        profile_probe* const probe = timing && profiler_samples(*e.prof, tick + i) ? timing : nullptr;
+
+        profile_start(probe);
+        const input_t senses = calculate_senses(sim.w, sim.a);
+        profile_mark(probe, profile_phase::senses);
+        e.inputs[i] = senses | calculate_vision_input(sim.w, sim.a);
+        profile_mark(probe, profile_phase::vision);
+      }
+
+      const uint64_t batch_start = timing ? profile_now() : 0;
+
+      evaluate_nn_batch(e.population, e.inputs.data(), e.outputs.data(), begin, end);
+
+      if (timing) {
+        profile_ring_push(*thread_probe.ring, profile_phase::nn_eval, (profile_now() - batch_start) / (end - begin));
+      }
+
+      for (size_t i = begin; i < end; ++i) {
+        simulation& sim = e.sims[i];
+        const agent::action act = choose_nn_action(sim.a.nn, e.outputs[i], sim.a.rand);
+        const bool recording = e.recorder && i == e.recorder->instance;
+        profile_probe* const probe = timing && profiler_samples(*e.prof, tick + i) ? timing : nullptr;
+
+        if (recording) {
+          action_log_push(e.recorder->life, act);
+        }
+
+        profile_start(probe);
+
+        if (!simulation_tick(s, sim, act, probe)) {
+          population_store(e.population, i, sim.a.nn);
+
+          if (recording) {
+            life_recorder_died(*e.recorder, sim);
+          }
+        }
+      }
+    }
+  });
+
+  // Writing the log is left until the pool is done, so no thread stalls on it.
+  if (e.recorder) {
+    life_recorder_flush(*e.recorder);
+  }
+
+  e.tick += ticks;
+}
+
+// Merge the statistics gathered by every participant so far.
+inline statistics engine_statistics(const engine& e) {
+  statistics total;
+
+  for (const auto& p : e.per_thread) {
+    statistics_merge(total, p.stats);
+  }
+
+  return total;
+}
+
+// Write a snapshot of every instance and the statistics so far.
+inline bool engine_checkpoint(const engine& e, const std::string& path) {
+  return snapshot_write(path, e.sims.data(), e.sims.size(), engine_statistics(e), e.tick);
+}
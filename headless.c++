@@ -0,0 +1,284 @@
+
+// Headless driver: steps many independent (world, agent) instances in
+// parallel with no window and no SDL, and reports throughput and the merged
+// statistics. Build with something like
+//
+//   g++ -std=c++17 -O2 -pthread headless.c++ -o headless
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "engine.h"
+#include "metrics.h"
+
+namespace {
+
+struct options {
+  size_t instances = 1024;
+  long long ticks = 10000;
+  unsigned threads = 0;
+  int epoch = 1000;
+  uint64_t seed = 1;
+
+  std::string checkpoint;
+  long long checkpoint_every = 0;
+  std::string resume;
+
+  std::string record;
+  size_t record_instance = 0;
+
+  long long profile_period = 64;
+  std::string metrics;
+  long long metrics_interval = 1000;
+  bool metrics_binary = false;
+};
+
+void usage(const char* prog) {
+  std::cout << "usage: " << prog << " [--instances N] [--ticks N] [--threads N] [--epoch N] [--seed N]\n"
+            << "       [--checkpoint PATH [--checkpoint-every N]] [--resume PATH] [--record PATH [--record-instance N]]\n"
+            << "       [--profile-period N] [--metrics PATH [--metrics-interval N] [--metrics-format csv|binary]]\n"
+            << "  --instances         number of independent worlds to simulate (default 1024)\n"
+            << "  --ticks             ticks to run every instance for (default 10000)\n"
+            << "  --threads           worker threads, 0 for one per core (default 0)\n"
+            << "  --epoch             ticks between progress reports (default 1000)\n"
+            << "  --seed              master seed; the same seed gives the same run (default 1)\n"
+            << "  --checkpoint        write a snapshot of the run here when it ends\n"
+            << "  --checkpoint-every  also write it every N ticks (default 0, only at the end)\n"
+            << "  --resume            carry on from a snapshot instead of starting afresh\n"
+            << "  --record            save the longest life of one instance here, for game --replay\n"
+            << "  --record-instance   which instance to record (default 0)\n"
+            << "  --profile-period    time the phases of one instance-tick in N, 0 for none (default 64)\n"
+            << "  --metrics           stream phase latencies, ticks/s and death rates here\n"
+            << "  --metrics-interval  ticks between metrics reports (default 1000)\n"
+            << "  --metrics-format    csv or binary (default csv)\n";
+}
+
+bool parse_options(int argc, char* args[], options& opts) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = args[i];
+
+    if (i + 1 >= argc) {
+      return false;
+    }
+
+    if (!strcmp(arg, "--seed")) {
+      opts.seed = std::strtoull(args[++i], nullptr, 10);
+      continue;
+    }
+
+    if (!strcmp(arg, "--checkpoint")) {
+      opts.checkpoint = args[++i];
+      continue;
+    }
+
+    if (!strcmp(arg, "--resume")) {
+      opts.resume = args[++i];
+      continue;
+    }
+
+    if (!strcmp(arg, "--record")) {
+      opts.record = args[++i];
+      continue;
+    }
+
+    if (!strcmp(arg, "--metrics")) {
+      opts.metrics = args[++i];
+      continue;
+    }
+
+    if (!strcmp(arg, "--metrics-format")) {
+      const char* value = args[++i];
+
+      if (strcmp(value, "csv") && strcmp(value, "binary")) {
+        return false;
+      }
+      opts.metrics_binary = !strcmp(value, "binary");
+      continue;
+    }
+
+    const long long value = std::strtoll(args[++i], nullptr, 10);
+
+    if (value < 0) {
+      return false;
+    }
+
+    if (!strcmp(arg, "--instances")) {
+      opts.instances = value;
+    } else if (!strcmp(arg, "--ticks")) {
+      opts.ticks = value;
+    } else if (!strcmp(arg, "--threads")) {
+      opts.threads = value;
+    } else if (!strcmp(arg, "--epoch")) {
+      opts.epoch = std::max(1ll, value);
+    } else if (!strcmp(arg, "--checkpoint-every")) {
+      opts.checkpoint_every = value;
+    } else if (!strcmp(arg, "--record-instance")) {
+      opts.record_instance = value;
+    } else if (!strcmp(arg, "--profile-period")) {
+      opts.profile_period = value;
+    } else if (!strcmp(arg, "--metrics-interval")) {
+      opts.metrics_interval = std::max(1ll, value);
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void print_statistics(const statistics& s) {
+  std::cout << "ticks:                " << s.ticks << '\n'
+            << "longest life:         " << s.longest_life << '\n'
+            << "most fruit eaten:     " << s.most_fruit_eaten << '\n'
+            << "deaths by cold:       " << s.deaths_by_cold << '\n'
+            << "deaths by drowning:   " << s.deaths_by_drowning << '\n'
+            << "deaths by cactus:     " << s.deaths_by_cactus << '\n'
+            << "deaths by exhaustion: " << s.deaths_by_exhaustion << '\n'
+            << "deaths by gluttony:   " << s.deaths_by_gluttony << '\n';
+}
+
+void print_profile(const metrics& m, const profiler& prof) {
+  std::printf("%-14s %10s %10s %10s %12s\n", "phase", "p50 ns", "p99 ns", "max ns", "samples");
+
+  for (int p = 0; p < profile_phase_count; ++p) {
+    const phase_report r = phase_summary(m.total[p]);
+
+    if (r.samples) {
+      std::printf("%-14s %10.1f %10.1f %10.1f %12llu\n", profile_phase_name((profile_phase)p), r.p50_ns, r.p99_ns,
+                  r.max_ns, (unsigned long long)r.samples);
+    }
+  }
+
+  std::printf("samples dropped: %llu\n", (unsigned long long)profiler_dropped(prof));
+}
+
+}
+
+int main(int argc, char* args[]) {
+  options opts;
+
+  if (!parse_options(argc, args, opts)) {
+    usage(args[0]);
+    return 1;
+  }
+
+  thread_pool pool(opts.threads);
+  engine e;
+
+  if (opts.resume.empty()) {
+    engine_init(e, opts.instances, pool, opts.seed);
+
+    std::cout << "running " << opts.instances << " instances for " << opts.ticks
+              << " ticks on " << pool.size() << " threads, seed " << opts.seed << '\n';
+  } else {
+    std::unique_ptr<snapshot_map> snap(new snapshot_map);
+
+    if (!snap->open(opts.resume)) {
+      return 1;
+    }
+
+    engine_load(e, std::move(snap), pool);
+    opts.instances = e.sims.size();
+
+    std::cout << "resuming " << opts.instances << " instances from " << opts.resume << " at tick " << e.tick
+              << " for " << opts.ticks << " more ticks on " << pool.size() << " threads\n";
+  }
+
+  life_recorder recorder;
+
+  if (!opts.record.empty()) {
+    if (opts.record_instance >= e.sims.size()) {
+      usage(args[0]);
+      return 1;
+    }
+
+    recorder.instance = opts.record_instance;
+    recorder.path = opts.record;
+    engine_record(e, recorder);
+  }
+
+  profiler prof;
+  metrics m;
+
+  if (opts.profile_period > 0) {
+    profiler_init(prof, pool.size(), opts.profile_period);
+    e.prof = &prof;
+  }
+
+  metrics_begin(m, engine_statistics(e));
+
+  if (!opts.metrics.empty() && !metrics_open(m, opts.metrics, opts.metrics_binary)) {
+    return 1;
+  }
+
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+
+  for (long long done = 0; done < opts.ticks; ) {
+    long long ticks = std::min<long long>(opts.epoch - done % opts.epoch, opts.ticks - done);
+
+    if (!opts.metrics.empty()) {
+      ticks = std::min<long long>(ticks, opts.metrics_interval - (long long)(e.tick % opts.metrics_interval));
+    }
+
+    // The rings are only drained between runs, so each run must fit in them.
+    ticks = std::min<long long>(ticks, engine_profile_ticks(e));
+
+    // Stop on the checkpoint ticks so the snapshot lands exactly on them.
+    if (!opts.checkpoint.empty() && opts.checkpoint_every > 0) {
+      ticks = std::min<long long>(ticks, opts.checkpoint_every - (long long)(e.tick % opts.checkpoint_every));
+    }
+
+    engine_run(e, pool, (int)ticks);
+    done += ticks;
+
+    if (!opts.metrics.empty() && e.tick % opts.metrics_interval == 0) {
+      metrics_write(m, metrics_interval(m, prof, engine_statistics(e), e.tick));
+    } else {
+      // Keep the rings from filling up between reports.
+      metrics_collect(m, prof);
+    }
+
+    if (!opts.checkpoint.empty() && opts.checkpoint_every > 0 && e.tick % opts.checkpoint_every == 0) {
+      engine_checkpoint(e, opts.checkpoint);
+    }
+
+    if (done % opts.epoch != 0 && done != opts.ticks) {
+      continue;
+    }
+
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::printf("tick %llu: %.0f instance-ticks/s\n", (unsigned long long)e.tick, done * opts.instances / elapsed);
+  }
+
+  const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+  if (!opts.checkpoint.empty() && !engine_checkpoint(e, opts.checkpoint)) {
+    return 1;
+  }
+
+  print_statistics(engine_statistics(e));
+
+  if (e.prof) {
+    print_profile(m, prof);
+  }
+
+  std::printf("elapsed: %.3fs, %.0f instance-ticks/s\n", elapsed, opts.ticks * opts.instances / elapsed);
+
+  if (!opts.record.empty()) {
+    if (!engine_end_recording(e)) {
+      std::cerr << "no life of instance " << opts.record_instance << " was written to " << opts.record << '\n';
+      return 1;
+    }
+
+    std::cout << "longest recorded life: " << recorder.longest.ticks << " ticks, in " << opts.record << '\n';
+  }
+
+  return 0;
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+// Turns the profiler's samples and the running statistics into periodic
+// reports: p50/p99/max latency of every phase, instance-ticks per second and
+// the rate of each kind of death, for the interval since the last report.
+// Reports can be streamed to a CSV file or to a binary file of raw
+// metrics_report records behind a small header.
+//
+// Latencies are in nanoseconds. nn_eval is per agent; where nets are
+// evaluated in batches it's the batch's time shared out over its agents.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "profile.h"
+#include "sim.h"
+
+// Counts up to 16 are kept exactly; above that every power of two is split
+// into 8 buckets, so a percentile is off by at most an eighth.
+struct latency_histogram {
+  static const int exact = 16;
+  static const int sub_buckets = 8;
+  static const int buckets = exact + (32 - 4) * sub_buckets;
+
+  uint64_t bins[buckets] = { };
+  uint64_t samples = 0;
+  uint32_t max = 0;
+};
+
+inline int latency_bucket(const uint32_t counts) {
+  if (counts < latency_histogram::exact) {
+    return counts;
+  }
+
+  const int top = 31 - __builtin_clz(counts);
+
+  return latency_histogram::exact + (top - 4) * latency_histogram::sub_buckets + ((counts >> (top - 3)) & 7);
+}
+
+// The largest count that falls in the given bucket.
+inline uint32_t latency_bucket_limit(const int bucket) {
+  if (bucket < latency_histogram::exact) {
+    return bucket;
+  }
+
+  const int top = 4 + (bucket - latency_histogram::exact) / latency_histogram::sub_buckets;
+  const uint64_t sub = (bucket - latency_histogram::exact) % latency_histogram::sub_buckets;
+
+  return (uint32_t)(((latency_histogram::sub_buckets + sub + 1) << (top - 3)) - 1);
+}
+
+inline void latency_add(latency_histogram& h, const uint32_t counts) {
+  ++h.bins[latency_bucket(counts)];
+  ++h.samples;
+  h.max = std::max(h.max, counts);
+}
+
+// The count below which the given fraction of the samples lie.
+inline uint32_t latency_percentile(const latency_histogram& h, const double fraction) {
+  const uint64_t rank = (uint64_t)(fraction * h.samples);
+  uint64_t seen = 0;
+
+  for (int b = 0; b < latency_histogram::buckets; ++b) {
+    seen += h.bins[b];
+
+    if (seen > rank) {
+      return std::min(latency_bucket_limit(b), h.max);
+    }
+  }
+
+  return h.max;
+}
+
+struct phase_report {
+  uint64_t samples;
+  double p50_ns;
+  double p99_ns;
+  double max_ns;
+};
+
+struct metrics_report {
+  // Where the interval ended, and how long it took.
+  uint64_t tick;
+  double seconds;
+
+  double ticks_per_second;
+
+  // Deaths per thousand instance-ticks.
+  double deaths_by_cold;
+  double deaths_by_drowning;
+  double deaths_by_cactus;
+  double deaths_by_exhaustion;
+  double deaths_by_gluttony;
+
+  phase_report phases[profile_phase_count];
+
+  // Samples lost to full rings since the start.
+  uint64_t dropped;
+};
+
+static_assert(std::is_trivially_copyable<metrics_report>::value, "reports are written as raw bytes");
+
+const uint32_t metrics_version = 1;
+
+const char metrics_magic[8] = { 'G', 'A', 'M', 'E', 'M', 'E', 'T', 'R' };
+
+struct metrics_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t phases;
+  uint32_t report_size;
+  uint32_t reserved;
+};
+
+using file_ptr = std::unique_ptr<std::FILE, decltype(&std::fclose)>;
+
+struct metrics {
+  // Since the last report, and since the start.
+  latency_histogram interval[profile_phase_count];
+  latency_histogram total[profile_phase_count];
+
+  statistics last_stats;
+  std::chrono::steady_clock::time_point last_time;
+
+  file_ptr out { nullptr, std::fclose };
+  bool binary = false;
+};
+
+// Start measuring from the given statistics, which may already have counts
+// in them when a run is resumed.
+inline void metrics_begin(metrics& m, const statistics& stats) {
+  for (int p = 0; p < profile_phase_count; ++p) {
+    m.interval[p] = latency_histogram();
+    m.total[p] = latency_histogram();
+  }
+
+  m.last_stats = stats;
+  m.last_time = std::chrono::steady_clock::now();
+}
+
+// Also stream every report to the given file.
+inline bool metrics_open(metrics& m, const std::string& path, const bool binary) {
+  m.out.reset(std::fopen(path.c_str(), binary ? "wb" : "w"));
+  m.binary = binary;
+
+  if (!m.out) {
+    std::cerr << "could not create " << path << ": " << strerror(errno) << '\n';
+    return false;
+  }
+
+  if (binary) {
+    metrics_header h;
+    memset(&h, 0, sizeof(h));
+
+    memcpy(h.magic, metrics_magic, sizeof(h.magic));
+    h.version = metrics_version;
+    h.phases = profile_phase_count;
+    h.report_size = sizeof(metrics_report);
+
+    std::fwrite(&h, sizeof(h), 1, m.out.get());
+  } else {
+    std::fprintf(m.out.get(), "tick,seconds,ticks_per_second,deaths_by_cold,deaths_by_drowning,deaths_by_cactus,"
+                              "deaths_by_exhaustion,deaths_by_gluttony");
+
+    for (int p = 0; p < profile_phase_count; ++p) {
+      const char* name = profile_phase_name((profile_phase)p);
+
+      std::fprintf(m.out.get(), ",%s_samples,%s_p50_ns,%s_p99_ns,%s_max_ns", name, name, name, name);
+    }
+
+    std::fprintf(m.out.get(), ",dropped\n");
+  }
+
+  return true;
+}
+
+// Pull everything out of the profiler's rings into the histograms.
+inline void metrics_collect(metrics& m, profiler& p) {
+  for (auto& ring : p.rings) {
+    profile_ring_drain(*ring, [&m](const profile_sample& sample) {
+      latency_add(m.interval[(int)sample.phase], sample.counts);
+      latency_add(m.total[(int)sample.phase], sample.counts);
+    });
+  }
+}
+
+inline phase_report phase_summary(const latency_histogram& h) {
+  const double counts_per_ns = profile_counts_per_ns();
+
+  return {
+    h.samples,
+    latency_percentile(h, 0.5) / counts_per_ns,
+    latency_percentile(h, 0.99) / counts_per_ns,
+    h.max / counts_per_ns,
+  };
+}
+
+// Close the current interval at the given tick and start the next one.
+inline metrics_report metrics_interval(metrics& m, profiler& p, const statistics& stats, const uint64_t tick) {
+  metrics_collect(m, p);
+
+  const auto now = std::chrono::steady_clock::now();
+
+  metrics_report r;
+  memset(&r, 0, sizeof(r));
+
+  r.tick = tick;
+  r.seconds = std::chrono::duration<double>(now - m.last_time).count();
+
+  const double ticks = (double)(stats.ticks - m.last_stats.ticks);
+  const double per_1k = ticks > 0 ? 1000 / ticks : 0;
+
+  r.ticks_per_second = r.seconds > 0 ? ticks / r.seconds : 0;
+  r.deaths_by_cold = (double)(stats.deaths_by_cold - m.last_stats.deaths_by_cold) * per_1k;
+  r.deaths_by_drowning = (double)(stats.deaths_by_drowning - m.last_stats.deaths_by_drowning) * per_1k;
+  r.deaths_by_cactus = (double)(stats.deaths_by_cactus - m.last_stats.deaths_by_cactus) * per_1k;
+  r.deaths_by_exhaustion = (double)(stats.deaths_by_exhaustion - m.last_stats.deaths_by_exhaustion) * per_1k;
+  r.deaths_by_gluttony = (double)(stats.deaths_by_gluttony - m.last_stats.deaths_by_gluttony) * per_1k;
+
+  for (int ph = 0; ph < profile_phase_count; ++ph) {
+    r.phases[ph] = phase_summary(m.interval[ph]);
+    m.interval[ph] = latency_histogram();
+  }
+
+  r.dropped = profiler_dropped(p);
+
+  m.last_stats = stats;
+  m.last_time = now;
+
+  return r;
+}
+
+inline void metrics_write(metrics& m, const metrics_report& r) {
+  std::FILE* const f = m.out.get();
+
+  if (!f) {
+    return;
+  }
+
+  if (m.binary) {
+    std::fwrite(&r, sizeof(r), 1, f);
+  } else {
+    std::fprintf(f, "%llu,%.6f,%.1f,%.4f,%.4f,%.4f,%.4f,%.4f", (unsigned long long)r.tick, r.seconds,
+                 r.ticks_per_second, r.deaths_by_cold, r.deaths_by_drowning, r.deaths_by_cactus,
+                 r.deaths_by_exhaustion, r.deaths_by_gluttony);
+
+    for (const phase_report& p : r.phases) {
+      std::fprintf(f, ",%llu,%.1f,%.1f,%.1f", (unsigned long long)p.samples, p.p50_ns, p.p99_ns, p.max_ns);
+    }
+
+    std::fprintf(f, ",%llu\n", (unsigned long long)r.dropped);
+  }
+
+  std::fflush(f);
+}
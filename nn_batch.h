@@ -0,0 +1,216 @@
+#pragma once
+
+// Evaluates the first layer of many perceptron nets at once. The genomes are
+// kept as a structure of arrays, one array per node and field, so that the
+// same node of consecutive agents sits in consecutive 16-bit lanes and a
+// single vector instruction can and/xor/popcount/threshold a whole batch of
+// agents. The result for every agent is bit-identical to evaluate_nn_output.
+//
+// The vector kernels are compiled with per-function target attributes and
+// picked at runtime, so the binary doesn't need to be built for AVX2 to use
+// it, and still runs on machines without it.
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NN_BATCH_X86 1
+#endif
+
+#include "sim.h"
+
+using perceptron_layer1 = decltype(perceptron_agent::perceptron_nn::layer1);
+
+static_assert(perceptron_layer1::layersize <= 16, "batched outputs are 16 bits wide");
+
+struct perceptron_population {
+  static const size_t nodes = perceptron_layer1::layersize;
+
+  // Arrays are padded out to a whole number of the widest vector, so the
+  // kernels never need a scalar tail.
+  static const size_t lanes = 32;
+
+  size_t size = 0;
+
+  std::vector<input_t> and_mask[nodes];
+  std::vector<input_t> xor_mask[nodes];
+
+  // popcount of a 16-bit value is in [0, 16], so clamping the thresholds to
+  // 16 bits doesn't change the outcome of any comparison.
+  std::vector<int16_t> threshold[nodes];
+};
+
+inline void population_resize(perceptron_population& pop, const size_t size) {
+  const size_t padded = (size + perceptron_population::lanes - 1) & ~(perceptron_population::lanes - 1);
+
+  pop.size = size;
+
+  for (size_t n = 0; n < perceptron_population::nodes; ++n) {
+    pop.and_mask[n].resize(padded);
+    pop.xor_mask[n].resize(padded);
+    pop.threshold[n].resize(padded);
+  }
+}
+
+// Copy one agent's net into the population.
+inline void population_store(perceptron_population& pop, const size_t i,
+                             const perceptron_agent::perceptron_nn& nn) {
+  for (size_t n = 0; n < perceptron_population::nodes; ++n) {
+    pop.and_mask[n][i] = nn.layer1.and_mask[n];
+    pop.xor_mask[n][i] = nn.layer1.xor_mask[n];
+    pop.threshold[n][i] = (int16_t)std::min(std::max(nn.layer1.threshold[n], -0x8000), 0x7fff);
+  }
+}
+
+enum class nn_batch_isa {
+  scalar,
+  avx2,
+  avx512
+};
+
+inline const char* nn_batch_isa_name(const nn_batch_isa isa) {
+  switch (isa) {
+  case nn_batch_isa::scalar: return "scalar";
+  case nn_batch_isa::avx2: return "avx2";
+  case nn_batch_isa::avx512: return "avx512";
+  }
+
+  return "unknown";
+}
+
+inline bool nn_batch_isa_supported(const nn_batch_isa isa) {
+  switch (isa) {
+  case nn_batch_isa::scalar:
+    return true;
+#ifdef NN_BATCH_X86
+  case nn_batch_isa::avx2:
+    return __builtin_cpu_supports("avx2");
+  case nn_batch_isa::avx512:
+    return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512bitalg");
+#endif
+  default:
+    return false;
+  }
+}
+
+// The kernels all compute outputs[i] for i in [begin, end), working in whole
+// vectors, so begin should be a multiple of perceptron_population::lanes and
+// inputs and outputs (indexed like the population) need room up to end
+// rounded up to a multiple of lanes.
+
+inline void evaluate_nn_batch_scalar(const perceptron_population& pop, const input_t* const inputs,
+                                     uint16_t* const outputs, const size_t begin, const size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    uint16_t output = 0;
+
+    for (size_t n = 0; n < perceptron_population::nodes; ++n) {
+      const input_t result = (pop.and_mask[n][i] & inputs[i]) ^ pop.xor_mask[n][i];
+      const int bitcount = __builtin_popcount(result & (input_t)input_mask::dead_inputs_mask);
+
+      output |= (uint16_t)(bitcount >= pop.threshold[n][i]) << n;
+    }
+
+    outputs[i] = output;
+  }
+}
+
+#ifdef NN_BATCH_X86
+
+__attribute__((target("avx2")))
+inline __m256i popcount_epi16_avx2(const __m256i v) {
+  // Nibble lookup with vpshufb, then fold the two byte counts of every lane.
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+
+  const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibbles));
+  const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+  const __m256i bytes = _mm256_add_epi8(lo, hi);
+
+  return _mm256_add_epi16(_mm256_and_si256(bytes, _mm256_set1_epi16(0xff)),
+                          _mm256_srli_epi16(bytes, 8));
+}
+
+__attribute__((target("avx2")))
+inline void evaluate_nn_batch_avx2(const perceptron_population& pop, const input_t* const inputs,
+                                   uint16_t* const outputs, const size_t begin, const size_t end) {
+  const __m256i live = _mm256_set1_epi16((int16_t)(input_t)input_mask::dead_inputs_mask);
+
+  for (size_t i = begin; i < end; i += 16) {
+    const __m256i in = _mm256_loadu_si256((const __m256i*)(inputs + i));
+    __m256i output = _mm256_setzero_si256();
+
+    for (size_t n = 0; n < perceptron_population::nodes; ++n) {
+      const __m256i and_mask = _mm256_loadu_si256((const __m256i*)(pop.and_mask[n].data() + i));
+      const __m256i xor_mask = _mm256_loadu_si256((const __m256i*)(pop.xor_mask[n].data() + i));
+      const __m256i threshold = _mm256_loadu_si256((const __m256i*)(pop.threshold[n].data() + i));
+
+      const __m256i result = _mm256_and_si256(_mm256_xor_si256(_mm256_and_si256(and_mask, in), xor_mask), live);
+      const __m256i below = _mm256_cmpgt_epi16(threshold, popcount_epi16_avx2(result));
+
+      output = _mm256_or_si256(output, _mm256_andnot_si256(below, _mm256_set1_epi16(1 << n)));
+    }
+
+    _mm256_storeu_si256((__m256i*)(outputs + i), output);
+  }
+}
+
+__attribute__((target("avx512bw,avx512bitalg")))
+inline void evaluate_nn_batch_avx512(const perceptron_population& pop, const input_t* const inputs,
+                                     uint16_t* const outputs, const size_t begin, const size_t end) {
+  const __m512i live = _mm512_set1_epi16((int16_t)(input_t)input_mask::dead_inputs_mask);
+
+  for (size_t i = begin; i < end; i += 32) {
+    const __m512i in = _mm512_loadu_si512(inputs + i);
+    __m512i output = _mm512_setzero_si512();
+
+    for (size_t n = 0; n < perceptron_population::nodes; ++n) {
+      const __m512i and_mask = _mm512_loadu_si512(pop.and_mask[n].data() + i);
+      const __m512i xor_mask = _mm512_loadu_si512(pop.xor_mask[n].data() + i);
+      const __m512i threshold = _mm512_loadu_si512(pop.threshold[n].data() + i);
+
+      const __m512i result = _mm512_and_si512(_mm512_xor_si512(_mm512_and_si512(and_mask, in), xor_mask), live);
+      const __mmask32 active = _mm512_cmpge_epi16_mask(_mm512_popcnt_epi16(result), threshold);
+
+      output = _mm512_or_si512(output, _mm512_maskz_set1_epi16(active, 1 << n));
+    }
+
+    _mm512_storeu_si512(outputs + i, output);
+  }
+}
+
+#endif
+
+inline void evaluate_nn_batch(const nn_batch_isa isa, const perceptron_population& pop,
+                              const input_t* const inputs, uint16_t* const outputs,
+                              const size_t begin, const size_t end) {
+  switch (isa) {
+#ifdef NN_BATCH_X86
+  case nn_batch_isa::avx512:
+    evaluate_nn_batch_avx512(pop, inputs, outputs, begin, end);
+    return;
+  case nn_batch_isa::avx2:
+    evaluate_nn_batch_avx2(pop, inputs, outputs, begin, end);
+    return;
+#endif
+  default:
+    evaluate_nn_batch_scalar(pop, inputs, outputs, begin, end);
+    return;
+  }
+}
+
+// The widest kernel this machine can run, worked out once.
+inline nn_batch_isa nn_batch_best_isa() {
+  static const nn_batch_isa best =
+    nn_batch_isa_supported(nn_batch_isa::avx512) ? nn_batch_isa::avx512 :
+    nn_batch_isa_supported(nn_batch_isa::avx2) ? nn_batch_isa::avx2 :
+    nn_batch_isa::scalar;
+
+  return best;
+}
+
+inline void evaluate_nn_batch(const perceptron_population& pop, const input_t* const inputs,
+                              uint16_t* const outputs, const size_t begin, const size_t end) {
+  evaluate_nn_batch(nn_batch_best_isa(), pop, inputs, outputs, begin, end);
+}
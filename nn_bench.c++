@@ -0,0 +1,105 @@
+
+// Microbenchmark for the batched perceptron evaluator: checks every kernel
+// this machine supports against evaluate_nn_output, then reports how many
+// agent evaluations per second each of them manages. Build with something like
+//
+//   g++ -std=c++17 -O2 nn_bench.c++ -o nn_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "nn_batch.h"
+
+int main(int argc, char* args[]) {
+  const size_t agents = argc > 1 ? std::strtoull(args[1], nullptr, 10) : 4096;
+  const int rounds = argc > 2 ? std::atoi(args[2]) : 2000;
+
+  std::mt19937 gen(1234);
+  rng rand(1234);
+  std::uniform_int_distribution<int> input_dis(0, 0xffff);
+  std::uniform_int_distribution<int> threshold_dis(-2, input_mask::num_active_inputs + 2);
+
+  std::vector<perceptron_agent::perceptron_nn> nets(agents);
+  perceptron_population pop;
+
+  population_resize(pop, agents);
+
+  for (size_t i = 0; i < agents; ++i) {
+    randomize_nn(nets[i], rand);
+
+    // Exercise the comparison with thresholds on both sides of the popcount
+    // range, not just the default.
+    for (auto& threshold : nets[i].layer1.threshold) {
+      threshold = threshold_dis(gen);
+    }
+
+    population_store(pop, i, nets[i]);
+  }
+
+  std::vector<input_t> inputs(pop.and_mask[0].size());
+  std::vector<uint16_t> outputs(inputs.size());
+
+  for (size_t i = 0; i < agents; ++i) {
+    inputs[i] = input_dis(gen);
+  }
+
+  using clock = std::chrono::steady_clock;
+
+  // The baseline: one agent at a time through evaluate_nn_output.
+  {
+    uint64_t sink = 0;
+    const auto start = clock::now();
+
+    for (int r = 0; r < rounds; ++r) {
+      for (size_t i = 0; i < agents; ++i) {
+        sink += evaluate_nn_output(nets[i], inputs[i] ^ r);
+      }
+    }
+
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::printf("%-8s %12.4g agent-evaluations/s (%llu)\n", "per-agent",
+                agents * (double)rounds / elapsed, (unsigned long long)sink);
+  }
+
+  bool ok = true;
+
+  for (const nn_batch_isa isa : { nn_batch_isa::scalar, nn_batch_isa::avx2, nn_batch_isa::avx512 }) {
+    if (!nn_batch_isa_supported(isa)) {
+      std::printf("%-8s unsupported on this machine\n", nn_batch_isa_name(isa));
+      continue;
+    }
+
+    evaluate_nn_batch(isa, pop, inputs.data(), outputs.data(), 0, agents);
+
+    for (size_t i = 0; i < agents; ++i) {
+      if (outputs[i] != evaluate_nn_output(nets[i], inputs[i])) {
+        std::printf("%-8s MISMATCH at agent %zu: %#x != %#llx\n", nn_batch_isa_name(isa), i, outputs[i],
+                    (unsigned long long)evaluate_nn_output(nets[i], inputs[i]));
+        ok = false;
+        break;
+      }
+    }
+
+    uint64_t sink = 0;
+    const auto start = clock::now();
+
+    for (int r = 0; r < rounds; ++r) {
+      inputs[r % agents] ^= r;
+      evaluate_nn_batch(isa, pop, inputs.data(), outputs.data(), 0, agents);
+      sink += outputs[r % agents];
+    }
+
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    std::printf("%-8s %12.4g agent-evaluations/s (%llu)\n", nn_batch_isa_name(isa),
+                agents * (double)rounds / elapsed, (unsigned long long)sink);
+  }
+
+  std::printf("best kernel: %s\n", nn_batch_isa_name(nn_batch_best_isa()));
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+// Cheap timing of the phases of a tick. A probe is handed down the tick; at
+// the end of each phase it reads the timestamp counter and pushes the cycles
+// spent since the previous mark into its thread's ring buffer. Nothing else
+// happens on the hot path: turning the cycles into histograms and reports is
+// left to whoever drains the rings (see metrics.h).
+//
+// Code that is handed a null probe skips the timing altogether, so callers
+// keep the overhead down by only passing one in for a sample of the ticks.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum class profile_phase : uint32_t {
+  senses,
+  vision,
+  nn_eval,
+  movement,
+  attributes,
+  death_check,
+  fruit_removal,
+  draw,
+  count
+};
+
+const int profile_phase_count = (int)profile_phase::count;
+
+inline const char* profile_phase_name(const profile_phase phase) {
+  switch (phase) {
+  case profile_phase::senses: return "senses";
+  case profile_phase::vision: return "vision";
+  case profile_phase::nn_eval: return "nn_eval";
+  case profile_phase::movement: return "movement";
+  case profile_phase::attributes: return "attributes";
+  case profile_phase::death_check: return "death_check";
+  case profile_phase::fruit_removal: return "fruit_removal";
+  case profile_phase::draw: return "draw";
+  case profile_phase::count: break;
+  }
+
+  return "?";
+}
+
+// The timestamp counter where there is one, nanoseconds elsewhere. rdtsc isn't
+// serializing, so very short phases come out a little smeared, which is fine
+// for a histogram.
+inline uint64_t profile_now() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// How many profile_now() counts make a nanosecond, measured once against the
+// steady clock the first time it's asked for.
+inline double profile_counts_per_ns() {
+  static const double counts_per_ns = []() {
+#if defined(__x86_64__) || defined(__i386__)
+    using clock = std::chrono::steady_clock;
+
+    const auto start = clock::now();
+    const uint64_t start_counts = profile_now();
+
+    while (clock::now() - start < std::chrono::milliseconds(20)) {
+    }
+
+    const double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+    return (profile_now() - start_counts) / ns;
+#else
+    return 1.0;
+#endif
+  }();
+
+  return counts_per_ns;
+}
+
+struct profile_sample {
+  profile_phase phase;
+  uint32_t counts;
+};
+
+// A single-producer, single-consumer ring of samples. The thread running the
+// ticks pushes and one other thread drains; when it is full, samples are
+// dropped and counted rather than making the producer wait.
+struct profile_ring {
+  static const size_t capacity = 1 << 16;
+
+  alignas(64) std::atomic<size_t> head { 0 };
+  std::atomic<uint64_t> dropped { 0 };
+
+  alignas(64) std::atomic<size_t> tail { 0 };
+
+  alignas(64) profile_sample samples[capacity];
+};
+
+inline void profile_ring_push(profile_ring& ring, const profile_phase phase, const uint64_t counts) {
+  const size_t head = ring.head.load(std::memory_order_relaxed);
+
+  if (head - ring.tail.load(std::memory_order_acquire) == profile_ring::capacity) {
+    ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+
+  ring.samples[head % profile_ring::capacity] = { phase, (uint32_t)std::min<uint64_t>(counts, UINT32_MAX) };
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+// Hand every sample in the ring to fn(sample), oldest first.
+template<typename F>
+void profile_ring_drain(profile_ring& ring, F&& fn) {
+  const size_t tail = ring.tail.load(std::memory_order_relaxed);
+  const size_t head = ring.head.load(std::memory_order_acquire);
+
+  for (size_t i = tail; i != head; ++i) {
+    fn(ring.samples[i % profile_ring::capacity]);
+  }
+
+  ring.tail.store(head, std::memory_order_release);
+}
+
+// One ring per thread that runs ticks, indexed like the thread pool's
+// participants.
+struct profiler {
+  std::vector<std::unique_ptr<profile_ring>> rings;
+
+  // Time one instance-tick in every period; a power of two.
+  uint64_t period = 64;
+};
+
+inline void profiler_init(profiler& p, const unsigned threads, const uint64_t period = 64) {
+  p.rings.clear();
+
+  for (unsigned i = 0; i < threads; ++i) {
+    p.rings.emplace_back(new profile_ring);
+  }
+
+  p.period = 1;
+
+  while (p.period < period) {
+    p.period *= 2;
+  }
+}
+
+inline uint64_t profiler_dropped(const profiler& p) {
+  uint64_t dropped = 0;
+
+  for (const auto& ring : p.rings) {
+    dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+
+  return dropped;
+}
+
+// Whether the n'th instance-tick is one of those that get timed.
+inline bool profiler_samples(const profiler& p, const uint64_t n) {
+  return (n & (p.period - 1)) == 0;
+}
+
+// Carried through one sampled tick on one thread.
+struct profile_probe {
+  profile_ring* ring = nullptr;
+  uint64_t last = 0;
+};
+
+inline void profile_start(profile_probe* const probe) {
+  if (probe) {
+    probe->last = profile_now();
+  }
+}
+
+// Close the given phase, which began at the previous mark (or the start).
+inline void profile_mark(profile_probe* const probe, const profile_phase phase) {
+  if (probe) {
+    const uint64_t now = profile_now();
+
+    profile_ring_push(*probe->ring, phase, now - probe->last);
+    probe->last = now;
+  }
+}
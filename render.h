@@ -0,0 +1,182 @@
+#pragma once
+
+// Drawing the world with SDL. The world lives in a single streaming texture
+// with one texel per tile, which the GPU scales up to fill the window; each
+// frame only the tiles that changed since the last one are uploaded.
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "sim.h"
+
+using texture_ptr = std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)>;
+
+inline uint32_t worldent_color(const worldent we) {
+  if (world_fruit & we) {
+    return 0xfcba03;
+  }
+
+  if (world_cactus & we) {
+    return 0xdd0000;
+  }
+
+  if (world_water & we) {
+    return 0x0000FF;
+  }
+
+  if (world_snow & we) {
+    return 0xadd8e6;
+  }
+
+  if (world_grass & we) {
+    return 0x00ff00;
+  }
+
+  return 0;
+}
+
+struct world_renderer {
+  texture_ptr texture { nullptr, SDL_DestroyTexture };
+
+  // The tiles as they were when the texture was last updated, and the texels
+  // we upload from.
+  std::array<uint8_t, world_width * world_height> shown;
+  std::array<uint32_t, world_width * world_height> pixels;
+
+  // Set until the first frame has uploaded the whole world.
+  bool stale = true;
+};
+
+inline bool world_renderer_init(world_renderer& wr, SDL_Renderer* const renderer) {
+  wr.texture.reset(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                     world_width, world_height));
+
+  if (!wr.texture) {
+    printf( "Could not create world texture! SDL Error: %s\n", SDL_GetError() );
+    return false;
+  }
+
+  // Tiles should stay crisp squares when scaled up.
+  SDL_SetTextureScaleMode(wr.texture.get(), SDL_ScaleModeNearest);
+
+  wr.stale = true;
+  return true;
+}
+
+// Bring the world texture up to date with w, uploading only the bounding box
+// of the tiles that changed since the previous call.
+inline void world_renderer_update(world_renderer& wr, const world& w) {
+  int min_x = world_width, max_x = -1;
+  int min_y = world_height, max_y = -1;
+
+  for (int y = 0; y < world_height; ++y) {
+    const size_t row = (size_t)y * world_width;
+
+    if (!wr.stale && !memcmp(&wr.shown[row], &w.tiles[row], world_width)) {
+      continue;
+    }
+
+    for (int x = 0; x < world_width; ++x) {
+      const uint8_t tile = w.tiles[row + x];
+
+      if (!wr.stale && wr.shown[row + x] == tile) {
+        continue;
+      }
+
+      wr.shown[row + x] = tile;
+      wr.pixels[row + x] = 0xff000000 | worldent_color((worldent)tile);
+
+      min_x = std::min(min_x, x);
+      max_x = std::max(max_x, x);
+      min_y = std::min(min_y, y);
+      max_y = std::max(max_y, y);
+    }
+  }
+
+  wr.stale = false;
+
+  if (max_x < 0) {
+    return;
+  }
+
+  const SDL_Rect dirty = { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+
+  SDL_UpdateTexture(wr.texture.get(), &dirty, &wr.pixels[(size_t)min_y * world_width + min_x],
+                    world_width * sizeof(uint32_t));
+}
+
+// Draw the world scaled up to the whole render target, with the agent (and
+// what it can see, when DRAW_VISION is on) on top.
+inline void world_draw(world_renderer& wr, const agent& a, const world& w, SDL_Renderer* const renderer
+#ifdef DRAW_VISION
+                       , const std::vector<point_with_color>& visible_points
+#endif
+                       ) {
+  world_renderer_update(wr, w);
+
+  SDL_RenderCopy(renderer, wr.texture.get(), nullptr, nullptr);
+
+  int screen_width = 0, screen_height = 0;
+  SDL_GetRendererOutputSize(renderer, &screen_width, &screen_height);
+
+  const int x_ratio = std::max(1, screen_width / world_width);
+  const int y_ratio = std::max(1, screen_height / world_height);
+
+  const SDL_Rect outlineRect = { a.x_pos * x_ratio, a.y_pos * y_ratio, x_ratio, y_ratio };
+  SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, 0xff);
+  SDL_RenderFillRect(renderer, &outlineRect);
+
+#ifdef DRAW_VISION
+  for (const auto point : visible_points) {
+    const SDL_Rect outlineRect = { point.x * x_ratio, point.y * y_ratio, x_ratio, y_ratio };
+    SDL_SetRenderDrawColor(renderer, 0xff, 0xff, 0xff, point.color);
+    SDL_RenderFillRect(renderer, &outlineRect);
+  }
+#endif
+}
+
+// A line of text that is only rasterized again when its contents change.
+struct text_label {
+  std::string text;
+  texture_ptr texture { nullptr, SDL_DestroyTexture };
+  SDL_Rect rect { };
+};
+
+inline void get_text_and_rect(SDL_Renderer *renderer, int x, int y, const char *text,
+                              TTF_Font *font, SDL_Texture **texture, SDL_Rect *rect) {
+  int text_width;
+  int text_height;
+  SDL_Surface *surface;
+  SDL_Color textColor = {255, 255, 255, 0};
+
+  surface = TTF_RenderText_Solid(font, text, textColor);
+  *texture = SDL_CreateTextureFromSurface(renderer, surface);
+  text_width = surface->w;
+  text_height = surface->h;
+  SDL_FreeSurface(surface);
+  rect->x = x;
+  rect->y = y;
+  rect->w = text_width;
+  rect->h = text_height;
+}
+
+inline void text_label_draw(text_label& label, SDL_Renderer* const renderer, TTF_Font* const font,
+                            const int x, const int y, const std::string& text) {
+  if (!label.texture || label.text != text) {
+    SDL_Texture* texture = nullptr;
+
+    get_text_and_rect(renderer, x, y, text.empty() ? " " : text.c_str(), font, &texture, &label.rect);
+    label.texture.reset(texture);
+    label.text = text;
+  }
+
+  label.rect.x = x;
+  label.rect.y = y;
+
+  SDL_RenderCopy(renderer, label.texture.get(), nullptr, &label.rect);
+}
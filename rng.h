@@ -0,0 +1,60 @@
+#pragma once
+
+// A small, fast random number generator (xoshiro256**). Every world and agent
+// owns one, so simulations never share generator state and can be stepped in
+// parallel, and everything they do follows from a single master seed.
+
+#include <cstdint>
+
+// splitmix64, used to spread a seed over the generator's state and to derive
+// independent streams from a master seed.
+inline uint64_t splitmix64(uint64_t& state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+struct rng {
+  uint64_t s[4];
+
+  explicit rng(uint64_t seed = 0) {
+    for (auto& word : s) {
+      word = splitmix64(seed);
+    }
+  }
+
+  uint64_t next() {
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+  }
+
+  // A number in [0, n), by multiplying instead of dividing. The bias is at
+  // most n / 2^32, which is nothing for the small ranges we draw from.
+  uint32_t below(const uint32_t n) {
+    return (uint32_t)(((next() >> 32) * n) >> 32);
+  }
+
+private:
+  static uint64_t rotl(const uint64_t x, const int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+};
+
+// The seed for stream number n of a master seed. Different streams of the
+// same master seed are independent of each other.
+inline uint64_t rng_stream_seed(uint64_t master, const uint64_t n) {
+  master ^= n * 0xd1b54a32d192ed03ull;
+  splitmix64(master);
+  return splitmix64(master);
+}
@@ -0,0 +1,960 @@
+#pragma once
+
+// The simulation proper: agents, their nets, the world they live in and the
+// tick that moves everything forward. Nothing in here depends on SDL, so it is
+// shared by the windowed viewer and the headless engine.
+
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <vector>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "profile.h"
+#include "rng.h"
+
+using input_t = uint16_t;
+
+constexpr input_t bit(const int n) {
+  return (input_t)1 << n;
+}
+
+namespace input_mask {
+
+const input_t satiated = bit(0);
+
+const input_t front_fruit = bit(1);
+const input_t front_cactus = bit(2);
+const input_t left_fruit = bit(3);
+const input_t left_cactus = bit(4);
+const input_t right_fruit = bit(5);
+const input_t right_cactus = bit(6);
+
+const input_t heat_low = bit(7);
+const input_t heat_verylow = bit(8);
+
+const input_t stamina_low = bit(9);
+const input_t stamina_verylow = bit(10);
+
+const input_t underwater = bit(11);
+const input_t snow = bit(12);
+
+const input_t oxygen_low = bit(13);
+const input_t oxygen_verylow = bit(14);
+
+const input_t very_satiated = bit(15);
+
+const int num_active_inputs = 16; // all 16 bits used
+
+// This mask is applied after all calculations on the input, so that they always
+// get set to zero even if they're inverted or whatever. This is so that the
+// activation function sums only the bits that are useful.
+const size_t dead_inputs_mask = ~0ull;
+
+}
+
+struct general_agent {
+  enum direction {
+    direction_north,
+    direction_south,
+    direction_east,
+    direction_west
+  };
+
+  enum action {
+    action_nothing = 1,
+    action_moveforward = 2,
+    action_movebackward = 4,
+    action_moveleft = 8,
+    action_moveright = 16,
+  };
+};
+
+template<typename Input, typename Output, int Nodes>
+struct andxor_nn_layer {
+  static const size_t layersize = Nodes;
+
+  Input and_mask[Nodes] = { };
+  Input xor_mask[Nodes] = { };
+
+  // Thresholds for each node
+  int threshold[Nodes] = { };
+  
+  Output output;
+};
+
+struct perceptron_agent : general_agent {
+  int x_pos = 0, y_pos = 0;
+
+  int max_stamina = 300;
+  int stamina = 100;
+
+  int max_oxygen = 100;
+  int oxygen = 100;
+
+  int max_heat = 100;
+  int heat = 100;
+
+  direction facing = direction_north;
+
+  // this is half the width of the square of vision that the agent sits in the
+  // center of (i.e. it can see vision_distance units to the left, and to the
+  // right, and forward)
+  int vision_distance = 20;
+
+  /* This agent has no hidden layers. */
+
+  struct perceptron_nn {
+    andxor_nn_layer<input_t, uint64_t, 5> layer1;
+  } nn;
+
+  // Where the agent's random choices come from.
+  rng rand;
+
+  /* Statistics */
+
+  int ticks_alive = 0;
+  int total_fruit_eaten = 0;
+};
+
+using agent = perceptron_agent;
+
+inline void randomize_nn(perceptron_agent::perceptron_nn& nn, rng& rand) {
+  uint64_t rndmem[(sizeof(nn.layer1) + sizeof(uint64_t) - 1) / sizeof(uint64_t)] = { };
+
+  for (uint64_t& word : rndmem) {
+    word = rand.next();
+  }
+
+  memcpy(&nn.layer1, rndmem, sizeof(nn.layer1));
+
+  // All the thresholds are the same
+  for (auto& threshold : nn.layer1.threshold) {
+    threshold = input_mask::num_active_inputs / 2;
+  }
+}
+
+// Choose a random bit in a mask
+inline agent::action choose_random_action(const unsigned int bitset, rng& rand) {
+  if (!bitset) {
+    std::cout << "bitset empty, this is a bug\n";
+    return agent::action_nothing;
+  }
+
+  const int bitcount = __builtin_popcount(bitset);
+
+  if (bitcount == 1) {
+    return (agent::action)bitset;
+  }
+
+  const unsigned int choice = rand.below(bitcount);
+
+#ifdef __BMI2__
+  // Deposit a single bit into the choice'th set bit of the mask.
+  return (agent::action)_pdep_u32(1u << choice, bitset);
+#else
+  // Clear the lowest set bit choice times; the lowest one left is ours.
+  unsigned int rest = bitset;
+
+  for (unsigned int i = 0; i < choice; ++i) {
+    rest &= rest - 1;
+  }
+
+  return (agent::action)(1u << __builtin_ctz(rest));
+#endif
+}
+
+// Run the input through the net and return the mask of active output nodes.
+inline uint64_t evaluate_nn_output(const perceptron_agent::perceptron_nn& nn,
+                                   const input_t input) {
+  uint64_t output = 0;
+
+  for (size_t i = 0; i < nn.layer1.layersize; ++i) {
+    const auto result = (nn.layer1.and_mask[i] & input) ^ nn.layer1.xor_mask[i];
+    const auto bitcount = __builtin_popcount(result & input_mask::dead_inputs_mask);
+
+    uint64_t active = 0;
+
+    if (bitcount >= nn.layer1.threshold[i]) {
+      active = 1;
+    }
+
+    output |= active << i;
+  }
+
+  return output;
+}
+
+// Latch the net's output and pick one of the actions it activated.
+inline agent::action choose_nn_action(perceptron_agent::perceptron_nn& nn,
+                                      const uint64_t output, rng& rand) {
+  nn.layer1.output = output;
+
+  if (output) {
+    return choose_random_action(output, rand);
+  } else {
+    return agent::action_nothing;
+  }
+}
+
+inline agent::action evaluate_nn(perceptron_agent::perceptron_nn& nn,
+                                 const input_t input, rng& rand) {
+  return choose_nn_action(nn, evaluate_nn_output(nn, input), rand);
+}
+
+enum worldent {
+  world_grass = 1,
+  world_water = 2,
+  world_snow = 4,
+  world_fruit = 8,
+  world_cactus = 16
+};
+
+const worldent world_terrain_mask = (worldent)(world_grass | world_water | world_snow);
+
+const int world_width = 256;
+const int world_height = 256;
+
+// The world wraps around at its edges; keeping the dimensions powers of two
+// lets us wrap coordinates with a mask instead of a modulo and sign fix-up.
+static_assert((world_width & (world_width - 1)) == 0, "world_width must be a power of two");
+static_assert((world_height & (world_height - 1)) == 0, "world_height must be a power of two");
+
+static_assert(world_width % 64 == 0 && world_height % 64 == 0,
+              "the occupancy index packs whole rows and columns into 64-bit words");
+
+// A row (or column) of the occupancy index: one bit per tile along it.
+using world_row_bits = std::array<uint64_t, world_width / 64>;
+using world_column_bits = std::array<uint64_t, world_height / 64>;
+
+// A dense grid of tiles, one byte (a set of worldent flags) per tile, stored
+// row-major. Every tile starts out as plain grass.
+//
+// Alongside it we keep an index of where the fruit and cacti are, as a bitmask
+// per row and per column, so vision can find the nearest one along a line of
+// tiles with a few word operations instead of looking at every tile. The index
+// is only ever updated by world_putent, so all writes have to go through it.
+struct world {
+  std::array<uint8_t, world_width * world_height> tiles;
+
+  std::array<world_row_bits, world_height> cactus_rows { };
+  std::array<world_row_bits, world_height> fruit_rows { };
+  std::array<world_column_bits, world_width> cactus_columns { };
+  std::array<world_column_bits, world_width> fruit_columns { };
+
+  // Where the world's random choices (such as its layout) come from.
+  rng rand;
+
+  world() {
+    tiles.fill(world_grass);
+  }
+};
+
+inline int world_wrap_x(const int x) {
+  return x & (world_width - 1);
+}
+
+inline int world_wrap_y(const int y) {
+  return y & (world_height - 1);
+}
+
+inline size_t world_index(const int x, const int y) {
+  return (size_t)world_wrap_y(y) * world_width + world_wrap_x(x);
+}
+
+struct statistics {
+  // Summed over every instance of a run, so these outgrow 32 bits.
+  uint64_t ticks = 0;
+  int longest_life = 0;
+  int most_fruit_eaten = 0;
+
+  uint64_t deaths_by_cold = 0;
+  uint64_t deaths_by_drowning = 0;
+  uint64_t deaths_by_cactus = 0;
+  uint64_t deaths_by_exhaustion = 0;
+  uint64_t deaths_by_gluttony = 0;
+};
+
+// Fold the statistics gathered by one thread (or instance) into another.
+inline void statistics_merge(statistics& into, const statistics& from) {
+  into.ticks += from.ticks;
+  into.longest_life = std::max(into.longest_life, from.longest_life);
+  into.most_fruit_eaten = std::max(into.most_fruit_eaten, from.most_fruit_eaten);
+
+  into.deaths_by_cold += from.deaths_by_cold;
+  into.deaths_by_drowning += from.deaths_by_drowning;
+  into.deaths_by_cactus += from.deaths_by_cactus;
+  into.deaths_by_exhaustion += from.deaths_by_exhaustion;
+  into.deaths_by_gluttony += from.deaths_by_gluttony;
+}
+
+// The statistics one thread gathers while others gather theirs. Padded out to
+// a cache line so the threads don't false-share their counters.
+struct alignas(64) participant_statistics {
+  statistics stats;
+};
+
+struct point_with_color {
+  int x, y;
+  uint32_t color;
+};
+
+inline void agent_move(agent& a, int delta_ns, int delta_ew) {
+  a.x_pos = world_wrap_x(a.x_pos + delta_ew);
+  a.y_pos = world_wrap_y(a.y_pos + delta_ns);
+}
+
+template<size_t Words>
+inline void set_occupancy_bit(std::array<uint64_t, Words>& line, const int n, const bool set) {
+  const uint64_t bit = 1ull << (n % 64);
+
+  if (set) {
+    line[n / 64] |= bit;
+  } else {
+    line[n / 64] &= ~bit;
+  }
+}
+
+inline void world_putent(world& w, int x, int y, const worldent ent) {
+  x = world_wrap_x(x);
+  y = world_wrap_y(y);
+
+  w.tiles[world_index(x, y)] = ent;
+
+  set_occupancy_bit(w.cactus_rows[y], x, ent & world_cactus);
+  set_occupancy_bit(w.fruit_rows[y], x, ent & world_fruit);
+  set_occupancy_bit(w.cactus_columns[x], y, ent & world_cactus);
+  set_occupancy_bit(w.fruit_columns[x], y, ent & world_fruit);
+}
+
+inline worldent world_getent(const world& w, int x, int y) {
+  return (worldent)w.tiles[world_index(x, y)];
+}
+
+// The straightforward version of calculate_vision_input, which looks at every
+// tile of every band of vision in turn. Kept as the reference the indexed
+// version has to agree with.
+inline input_t calculate_vision_input_scan(const world& w, const agent& a) {
+  const int x = 0;
+  const int y = 1;
+
+  const int north_deltas[2] = { 0, -1 };
+  const int south_deltas[2] = { 0, 1 };
+  const int east_deltas[2] = { 1, 0 };
+  const int west_deltas[2] = { -1, 0 };
+
+  const int* forward_deltas = nullptr, * left_deltas = nullptr, * right_deltas = nullptr;
+  int forward_pos[2] { }, left_pos[2] { }, right_pos[2] { };
+
+  switch (a.facing) {
+  case agent::direction_north:
+    forward_pos[x] = a.x_pos; forward_pos[y] = a.y_pos - 1;
+    left_pos[x] = a.x_pos - 1; left_pos[y] = a.y_pos;
+    right_pos[x] = a.x_pos + 1; right_pos[y] = a.y_pos;
+    forward_deltas = north_deltas; right_deltas = east_deltas; left_deltas = west_deltas;
+    break;
+  case agent::direction_south:
+    forward_pos[x] = a.x_pos; forward_pos[y] = a.y_pos + 1;
+    left_pos[x] = a.x_pos + 1; left_pos[y] = a.y_pos;
+    right_pos[x] = a.x_pos - 1; right_pos[y] = a.y_pos;
+    forward_deltas = south_deltas; right_deltas = west_deltas; left_deltas = east_deltas;
+    break;
+  case agent::direction_east:
+    forward_pos[x] = a.x_pos + 1; forward_pos[y] = a.y_pos;
+    left_pos[x] = a.x_pos; left_pos[y] = a.y_pos - 1;
+    right_pos[x] = a.x_pos; right_pos[y] = a.y_pos + 1;
+    forward_deltas = east_deltas; right_deltas = south_deltas; left_deltas = north_deltas;
+    break;
+  case agent::direction_west:
+    forward_pos[x] = a.x_pos - 1; forward_pos[y] = a.y_pos;
+    left_pos[x] = a.x_pos; left_pos[y] = a.y_pos + 1;
+    right_pos[x] = a.x_pos; right_pos[y] = a.y_pos - 1;
+    forward_deltas = west_deltas; right_deltas = north_deltas; left_deltas = south_deltas;
+    break;
+  }
+
+  input_t vision_input = 0;
+
+  bool found_front = false,
+       found_left = false,
+       found_right = false;
+
+  for (int radius = 0; radius < a.vision_distance; ++radius) {
+    const int forward_vision_width = 3 + 2*radius;
+    const int side_vision_width = 3 + 2*radius;
+
+    // perform forward vision (3+2i tiles wide)
+    for (int tile = 0; !found_front && tile < forward_vision_width; ++tile) {
+      const int tilepos[2] = {
+        // This is a way of saying "iff we moved on the y axis to advance
+        // forward vision (i.e. north or south), then we want to move on the x
+        // axis to scan tiles for vision"; and vice versa.
+        forward_pos[x] + (forward_deltas[y] * forward_deltas[y]) * (-(forward_vision_width / 2) + tile),
+        forward_pos[y] + (forward_deltas[x] * forward_deltas[x]) * (-(forward_vision_width / 2) + tile),
+      };
+
+      const worldent tileent = world_getent(w, tilepos[x], tilepos[y]);
+
+      if (tileent & world_cactus) {
+        found_front = true;
+        vision_input |= input_mask::front_cactus;
+      } else if (tileent & world_fruit) {
+        found_front = true;
+        vision_input |= input_mask::front_fruit;
+      }
+    }
+
+    // perform left vision (3+2i tiles wide)
+    for (int tile = 0; tile < side_vision_width; ++tile) {
+      const int left_tilepos[2] = {
+        left_pos[x] + (left_deltas[y] * left_deltas[y]) * (-(forward_vision_width / 2) + tile),
+        left_pos[y] + (left_deltas[x] * left_deltas[x]) * (-(forward_vision_width / 2) + tile),
+      };
+
+      const worldent tileent = world_getent(w, left_tilepos[x], left_tilepos[y]);
+
+      if (tileent & world_cactus) {
+        found_left = true;
+        vision_input |= input_mask::left_cactus;
+      } else if (tileent & world_fruit) {
+        found_left = true;
+        vision_input |= input_mask::left_fruit;
+      }
+    }
+
+    // perform right vision (3+2i tiles wide)
+    for (int tile = 0; tile < side_vision_width; ++tile) {
+      const int right_tilepos[2] = {
+        right_pos[x] + (right_deltas[y] * right_deltas[y]) * (-(forward_vision_width / 2) + tile),
+        right_pos[y] + (right_deltas[x] * right_deltas[x]) * (-(forward_vision_width / 2) + tile),
+      };
+
+      const worldent tileent = world_getent(w, right_tilepos[x], right_tilepos[y]);
+
+      if (tileent & world_cactus) {
+        found_right = true;
+        vision_input |= input_mask::right_cactus;
+      } else if (tileent & world_fruit) {
+        found_right = true;
+        vision_input |= input_mask::right_fruit;
+      }
+    }
+
+    forward_pos[x] += forward_deltas[x]; forward_pos[y] += forward_deltas[y];
+    left_pos[x] += left_deltas[x]; left_pos[y] += left_deltas[y];
+    right_pos[x] += right_deltas[x]; right_pos[y] += right_deltas[y];
+  }
+
+  return vision_input;
+}
+
+// Where one of the three cones of vision starts and which way it grows. At
+// radius r the cone is the band of 3 + 2r tiles centred on center, lying on
+// the row (if along_x) or column line + r * line_step, scanned in increasing
+// order of x (or y).
+struct vision_cone {
+  int line;
+  int line_step;
+  int center;
+  bool along_x;
+};
+
+inline vision_cone make_vision_cone(const int pos[2], const int deltas[2]) {
+  const int x = 0;
+  const int y = 1;
+
+  if (deltas[y] != 0) {
+    return { pos[y], deltas[y], pos[x], true };
+  } else {
+    return { pos[x], deltas[x], pos[y], false };
+  }
+}
+
+// What one band of a cone of vision contains.
+struct vision_band {
+  // offset of the first tile in scan order holding fruit or a cactus, or -1
+  int first = -1;
+  bool first_is_cactus = false;
+
+  bool any_cactus = false;
+  // fruit on a tile that doesn't also hold a cactus
+  bool any_fruit = false;
+};
+
+// Bits [start, start + len) of a line of the occupancy index, wrapping around
+// its end. len must be at most 64.
+template<size_t Words>
+inline uint64_t occupancy_bits(const std::array<uint64_t, Words>& line, const int start, const int len) {
+  const int word = start / 64;
+  const int offset = start % 64;
+
+  uint64_t bits = line[word] >> offset;
+
+  if (offset) {
+    bits |= line[(word + 1) % Words] << (64 - offset);
+  }
+
+  return len < 64 ? bits & ((1ull << len) - 1) : bits;
+}
+
+template<size_t Words>
+inline vision_band scan_vision_band(const std::array<uint64_t, Words>& cactus,
+                                    const std::array<uint64_t, Words>& fruit,
+                                    const int start, const int len) {
+  const int line_length = Words * 64;
+
+  vision_band band;
+
+  for (int done = 0; done < len; done += 64) {
+    const int begin = (start + done) & (line_length - 1);
+    const int n = std::min(64, len - done);
+
+    const uint64_t c = occupancy_bits(cactus, begin, n);
+    const uint64_t f = occupancy_bits(fruit, begin, n);
+
+    if (band.first < 0 && (c | f)) {
+      const int first = __builtin_ctzll(c | f);
+
+      band.first = done + first;
+      band.first_is_cactus = (c >> first) & 1;
+    }
+
+    band.any_cactus |= c != 0;
+    band.any_fruit |= (f & ~c) != 0;
+  }
+
+  return band;
+}
+
+inline vision_band look_at_vision_band(const world& w, const vision_cone& cone, const int radius) {
+  const int line = cone.line + cone.line_step * radius;
+  const int start = cone.center - 1 - radius;
+  const int len = 3 + 2*radius;
+
+  if (cone.along_x) {
+    const int y = world_wrap_y(line);
+
+    return scan_vision_band(w.cactus_rows[y], w.fruit_rows[y], world_wrap_x(start), len);
+  } else {
+    const int x = world_wrap_x(line);
+
+    return scan_vision_band(w.cactus_columns[x], w.fruit_columns[x], world_wrap_y(start), len);
+  }
+}
+
+#ifdef DRAW_VISION
+// Record the first count tiles of a band of vision, the same way the tile by
+// tile scan did.
+inline void draw_vision_band(std::vector<point_with_color>& visible_points,
+                             const vision_cone& cone, const int radius, const int count) {
+  const int line = cone.line + cone.line_step * radius;
+  const int start = cone.center - 1 - radius;
+
+  for (int tile = 0; tile < count; ++tile) {
+    if (cone.along_x) {
+      visible_points.push_back({ .x = start + tile, .y = line, .color = (uint32_t)(170 - 4*radius) });
+    } else {
+      visible_points.push_back({ .x = line, .y = start + tile, .color = (uint32_t)(170 - 4*radius) });
+    }
+  }
+}
+#endif
+
+// Works out what the agent sees straight ahead, to its left and to its right.
+// Each of those is a cone that widens by a tile on either side for every tile
+// it reaches out, up to vision_distance. Ahead, only the nearest fruit or
+// cactus counts (the first in scan order, band by band); to the sides,
+// anything anywhere in the cone does.
+//
+// Each band is read from the occupancy index a 64-tile word at a time rather
+// than tile by tile, but there is still one band per radius and cone, so the
+// cost grows linearly with vision_distance. It stops early only once the
+// front has seen something and both sides have seen a cactus and a fruit,
+// which in a sparse world is rare.
+inline input_t calculate_vision_input(const world& w, const agent& a
+#ifdef DRAW_VISION
+                                      , std::vector<point_with_color>& visible_points
+#endif
+                                      ) {
+  const int x = 0;
+  const int y = 1;
+
+  const int north_deltas[2] = { 0, -1 };
+  const int south_deltas[2] = { 0, 1 };
+  const int east_deltas[2] = { 1, 0 };
+  const int west_deltas[2] = { -1, 0 };
+
+  const int* forward_deltas = nullptr, * left_deltas = nullptr, * right_deltas = nullptr;
+  int forward_pos[2] { }, left_pos[2] { }, right_pos[2] { };
+
+  switch (a.facing) {
+  case agent::direction_north:
+    forward_pos[x] = a.x_pos; forward_pos[y] = a.y_pos - 1;
+    left_pos[x] = a.x_pos - 1; left_pos[y] = a.y_pos;
+    right_pos[x] = a.x_pos + 1; right_pos[y] = a.y_pos;
+    forward_deltas = north_deltas; right_deltas = east_deltas; left_deltas = west_deltas;
+    break;
+  case agent::direction_south:
+    forward_pos[x] = a.x_pos; forward_pos[y] = a.y_pos + 1;
+    left_pos[x] = a.x_pos + 1; left_pos[y] = a.y_pos;
+    right_pos[x] = a.x_pos - 1; right_pos[y] = a.y_pos;
+    forward_deltas = south_deltas; right_deltas = west_deltas; left_deltas = east_deltas;
+    break;
+  case agent::direction_east:
+    forward_pos[x] = a.x_pos + 1; forward_pos[y] = a.y_pos;
+    left_pos[x] = a.x_pos; left_pos[y] = a.y_pos - 1;
+    right_pos[x] = a.x_pos; right_pos[y] = a.y_pos + 1;
+    forward_deltas = east_deltas; right_deltas = south_deltas; left_deltas = north_deltas;
+    break;
+  case agent::direction_west:
+    forward_pos[x] = a.x_pos - 1; forward_pos[y] = a.y_pos;
+    left_pos[x] = a.x_pos; left_pos[y] = a.y_pos + 1;
+    right_pos[x] = a.x_pos; right_pos[y] = a.y_pos - 1;
+    forward_deltas = west_deltas; right_deltas = north_deltas; left_deltas = south_deltas;
+    break;
+  }
+
+  const vision_cone front = make_vision_cone(forward_pos, forward_deltas);
+  const vision_cone left = make_vision_cone(left_pos, left_deltas);
+  const vision_cone right = make_vision_cone(right_pos, right_deltas);
+
+  input_t vision_input = 0;
+  bool found_front = false;
+
+  for (int radius = 0; radius < a.vision_distance; ++radius) {
+    if (!found_front) {
+      const vision_band band = look_at_vision_band(w, front, radius);
+
+      if (band.first >= 0) {
+        found_front = true;
+        vision_input |= band.first_is_cactus ? input_mask::front_cactus : input_mask::front_fruit;
+      }
+
+#ifdef DRAW_VISION
+      draw_vision_band(visible_points, front, radius, found_front ? band.first + 1 : 3 + 2*radius);
+#endif
+    }
+
+    const vision_band left_band = look_at_vision_band(w, left, radius);
+    const vision_band right_band = look_at_vision_band(w, right, radius);
+
+    vision_input |= (left_band.any_cactus ? input_mask::left_cactus : 0)
+                  | (left_band.any_fruit ? input_mask::left_fruit : 0)
+                  | (right_band.any_cactus ? input_mask::right_cactus : 0)
+                  | (right_band.any_fruit ? input_mask::right_fruit : 0);
+
+#ifdef DRAW_VISION
+    draw_vision_band(visible_points, left, radius, 3 + 2*radius);
+    draw_vision_band(visible_points, right, radius, 3 + 2*radius);
+#else
+    const input_t side_inputs = input_mask::left_fruit | input_mask::left_cactus
+                              | input_mask::right_fruit | input_mask::right_cactus;
+
+    // Nothing further out can change the answer.
+    if (found_front && (vision_input & side_inputs) == side_inputs) {
+      break;
+    }
+#endif
+  }
+
+  return vision_input;
+}
+
+inline agent::direction calc_new_direction(const agent::direction facing,
+                                           const agent::action a)
+{
+  const agent::direction vector_to_direction[3][3] = {
+    {           {},          agent::direction_north,            {}          },
+    { agent::direction_west,            {},           agent::direction_east },
+    {           {},          agent::direction_south,            {}          }
+  };
+
+  const int x = 0;
+  const int y = 1;
+  int vec[2] = { 0, 0 };
+
+  switch (facing) {
+  case agent::direction_north:
+    vec[x] = 0; vec[y] = -1;
+    break;
+  case agent::direction_south:
+    vec[x] = 0; vec[y] = 1;
+    break;
+  case agent::direction_east:
+    vec[x] = 1; vec[y] = 0;
+    break;
+  case agent::direction_west:
+    vec[x] = -1; vec[y] = 0;
+    break;
+  }
+
+  switch (a) {
+  case agent::action_moveforward:
+    return facing;
+
+  case agent::action_moveleft:
+    // rotate 90 degrees
+    std::swap(vec[x], vec[y]);
+    vec[x] *= -1;
+    // intentional fallthrough (turning left is like turning right and then
+    // going backwards)
+      
+  case agent::action_movebackward:
+    vec[x] *= -1;
+    vec[y] *= -1;
+    break;
+
+  case agent::action_moveright:
+    // rotate 90 degrees
+    std::swap(vec[x], vec[y]);
+    vec[x] *= -1;
+    break;
+  }
+
+  return vector_to_direction[1 + vec[y]][1 + vec[x]];
+}
+
+inline input_t calculate_senses(const world& w, const agent& a) {
+  input_t in = 0;
+
+  using namespace input_mask;
+
+  const worldent current_tile = world_getent(w, a.x_pos, a.y_pos);
+
+  // Attributes
+
+  if (a.stamina + a.max_stamina / 4 > a.max_stamina) {
+    in |= satiated;
+  }
+
+  if (a.stamina + a.max_stamina / 6 > a.max_stamina) {
+    in |= very_satiated;
+  }
+
+  if (a.stamina < a.max_stamina / 8) {
+    in |= stamina_low;
+  }
+
+  if (a.stamina < a.max_stamina / 16) {
+    in |= stamina_verylow;
+  }
+
+  if (a.oxygen < a.max_oxygen / 8) {
+    in |= oxygen_low;
+  }
+
+  if (a.oxygen < a.max_oxygen / 16) {
+    in |= oxygen_verylow;
+  }
+
+  if (a.heat < a.max_heat / 8) {
+    in |= heat_low;
+  }
+
+  if (a.heat < a.max_heat / 16) {
+    in |= heat_verylow;
+  }
+
+  // Environment
+
+  if (world_water & current_tile) {
+    in |= underwater;
+  }
+  if (world_snow & current_tile) {
+    in |= snow;
+  }
+
+  return in;
+}
+
+// With a probe, each part of the tick is timed from the probe's previous mark.
+inline bool runtick(statistics& s, world& w, agent& a, const agent::action act,
+                    profile_probe* const probe = nullptr) {
+  ++s.ticks;
+
+  /* Calculate the agent's new position and move it there */
+
+  const agent::direction new_direction = calc_new_direction(a.facing, act);
+
+  const int direction_delta[][2] = {
+    [agent::direction_north] = { -1, 0 },
+    [agent::direction_south] = { 1, 0 },
+    [agent::direction_east] = { 0, 1 },
+    [agent::direction_west] = { 0, -1 },
+  };
+
+  switch (act) {
+  case agent::action_nothing:
+    break;
+  case agent::action_moveforward:
+  case agent::action_moveleft:
+  case agent::action_moveright:
+    a.facing = new_direction;
+    // intentional fallthrough; moving backwards doesn't change the direction he's facing
+  case agent::action_movebackward:
+    agent_move(a, direction_delta[new_direction][0], direction_delta[new_direction][1]);
+    break;
+  }
+
+  profile_mark(probe, profile_phase::movement);
+
+  const worldent ent = world_getent(w, a.x_pos, a.y_pos);
+
+  /* Update the agent's attributes */
+
+  ++a.ticks_alive;
+  a.stamina -= 1;
+
+  if (ent & world_fruit) {
+    if (ent & world_snow) {
+      // cold fruit is worth less
+      a.stamina += 10;
+    } else if (ent & world_water) {
+      // wet fruit is worth more
+      a.stamina += 40;
+    } else {
+      a.stamina += 25;
+    }
+
+    ++a.total_fruit_eaten;
+  }
+
+  if (ent & world_snow) {
+    a.heat -= 1;
+  } else {
+    // every tick outside the snow warms him up
+    a.heat = std::min(a.heat + 2, a.max_heat);
+  }
+
+  if (ent & world_water) {
+    a.oxygen -= 1;
+  } else {
+    a.oxygen = a.max_oxygen;
+  }
+
+  profile_mark(probe, profile_phase::attributes);
+
+  /* Check if the agent is alive */
+
+  bool dead = false;
+
+  if (ent & world_cactus) {
+    // dead :(
+    dead = true;
+    ++s.deaths_by_cactus;
+  } else if (a.stamina <= 0) {
+    dead = true;
+    ++s.deaths_by_exhaustion;
+  } else if (a.stamina > a.max_stamina) {
+    dead = true;
+    ++s.deaths_by_gluttony;
+  } else if (a.oxygen <= 0) {
+    dead = true;
+    ++s.deaths_by_drowning;
+  } else if (a.heat <= 0) {
+    dead = true;
+    ++s.deaths_by_cold;
+  }
+
+  if (dead) {
+    s.longest_life = std::max(s.longest_life, a.ticks_alive);
+    s.most_fruit_eaten = std::max(s.most_fruit_eaten, a.total_fruit_eaten);
+  }
+
+  profile_mark(probe, profile_phase::death_check);
+
+  /* Remove fruit from the map */
+
+  if ((ent & world_terrain_mask) != ent) {
+    const worldent terrain = (worldent)(ent & world_terrain_mask);
+
+    world_putent(w, a.x_pos, a.y_pos, terrain ? terrain : world_grass);
+  }
+
+  profile_mark(probe, profile_phase::fruit_removal);
+
+  /* Report aliveness to caller */
+
+  return !dead;
+}
+
+inline void randomize_world(world& w, const uint64_t seed) {
+  w = world();
+  w.rand = rng(seed);
+
+  for (int n = 0; n < 100; ++n) {
+    int x = w.rand.below(world_width), y = w.rand.below(world_height);
+
+    world_putent(w, x, y, (worldent)(world_getent(w, x, y) | world_cactus));
+  }
+
+  for (int n = 0; n < 240; ++n) {
+    int x = w.rand.below(world_width), y = w.rand.below(world_height);
+
+    world_putent(w, x, y, (worldent)(world_getent(w, x, y) | world_fruit));
+  }
+}
+
+// One independent world with the single agent living in it.
+struct simulation {
+  world w;
+  agent a;
+
+  // Seeds each new world and agent. Seed it from rng_stream_seed of a master
+  // seed and everything that happens in this simulation is reproducible.
+  rng rand;
+};
+
+// Start a new life: a fresh random world and a fresh agent with a random net,
+// standing in the middle of it.
+inline void simulation_reset(simulation& sim) {
+  randomize_world(sim.w, sim.rand.next());
+
+  sim.a = agent();
+  sim.a.rand = rng(sim.rand.next());
+  randomize_nn(sim.a.nn, sim.a.rand);
+  sim.a.x_pos = world_width / 2;
+  sim.a.y_pos = world_height / 2;
+}
+
+// Let the agent's net pick its next action from what it senses and sees.
+inline agent::action simulation_think(simulation& sim
+#ifdef DRAW_VISION
+                                       , std::vector<point_with_color>& visible_points
+#endif
+                                       , profile_probe* const probe = nullptr) {
+  profile_start(probe);
+
+  input_t input = calculate_senses(sim.w, sim.a);
+  profile_mark(probe, profile_phase::senses);
+
+  input |= calculate_vision_input(sim.w, sim.a
+#ifdef DRAW_VISION
+                                  , visible_points
+#endif
+                                  );
+  profile_mark(probe, profile_phase::vision);
+
+  const agent::action act = evaluate_nn(sim.a.nn, input, sim.a.rand);
+  profile_mark(probe, profile_phase::nn_eval);
+
+  return act;
+}
+
+// Run one tick with the given action, starting a new life if the agent dies.
+// Returns whether the agent survived the tick.
+inline bool simulation_tick(statistics& s, simulation& sim, const agent::action act,
+                            profile_probe* const probe = nullptr) {
+  const bool alive = runtick(s, sim.w, sim.a, act, probe);
+
+  if (!alive) {
+    simulation_reset(sim);
+  }
+
+  return alive;
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+// Binary snapshots of a run, and logs of a single agent's life.
+//
+// A snapshot is a header followed by fixed-layout arrays of the in-memory
+// structs themselves: every instance's simulation (its world with the tiles,
+// occupancy index and generator, its agent with net and generator, and its
+// seeding generator), then the run's statistics. Nothing is parsed on load.
+// The file is mapped copy-on-write and the simulations are stepped right where
+// they lie, so a page is only read in when it is touched and only copied when
+// it is written. The header records the version and the sizes of the structs
+// it was written with, so a snapshot from an incompatible build is refused
+// rather than misread.
+//
+// An action log holds the world and agent at the start of one life plus the
+// action taken on every tick of it, packed two to a byte. runtick doesn't draw
+// on any randomness, so playing the actions back reproduces the life exactly.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+static_assert(std::is_trivially_copyable<world>::value, "worlds are snapshotted as raw bytes");
+static_assert(std::is_trivially_copyable<agent>::value, "agents are snapshotted as raw bytes");
+static_assert(std::is_trivially_copyable<simulation>::value, "simulations are snapshotted as raw bytes");
+static_assert(std::is_trivially_copyable<statistics>::value, "statistics are snapshotted as raw bytes");
+
+const uint32_t snapshot_version = 2;
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  // What the arrays below were laid out with.
+  uint32_t world_width;
+  uint32_t world_height;
+  uint32_t world_size;
+  uint32_t agent_size;
+  uint32_t rng_size;
+  uint32_t simulation_size;
+  uint32_t statistics_size;
+  uint32_t reserved;
+
+  uint64_t file_size;
+
+  // Ticks every instance had run when the snapshot was taken.
+  uint64_t tick;
+  uint64_t instances;
+
+  // Byte offsets from the start of the file.
+  uint64_t simulations_offset;
+  uint64_t statistics_offset;
+};
+
+static_assert(std::is_trivially_copyable<snapshot_header>::value, "the header is written as raw bytes");
+
+const char snapshot_magic[8] = { 'G', 'A', 'M', 'E', 'S', 'N', 'A', 'P' };
+
+// Where the simulations start; see snapshot_layout.
+const uint64_t snapshot_simulations_offset = 4096;
+
+inline uint64_t snapshot_align(const uint64_t offset) {
+  return (offset + 63) & ~(uint64_t)63;
+}
+
+inline snapshot_header snapshot_layout(const uint64_t instances, const uint64_t tick) {
+  snapshot_header h;
+  memset(&h, 0, sizeof(h));
+
+  memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+  h.version = snapshot_version;
+  h.header_size = sizeof(snapshot_header);
+
+  h.world_width = world_width;
+  h.world_height = world_height;
+  h.world_size = sizeof(world);
+  h.agent_size = sizeof(agent);
+  h.rng_size = sizeof(rng);
+  h.simulation_size = sizeof(simulation);
+  h.statistics_size = sizeof(statistics);
+
+  h.tick = tick;
+  h.instances = instances;
+
+  // Only the array of simulations starts on a page boundary. Simulations lie
+  // end to end inside it and aren't a whole number of pages, so neighbours
+  // share the page where one ends and the next starts, and that page is
+  // copied once for whichever of them writes to it first.
+  h.simulations_offset = snapshot_simulations_offset;
+  h.statistics_offset = snapshot_align(h.simulations_offset + instances * sizeof(simulation));
+  h.file_size = snapshot_align(h.statistics_offset + sizeof(statistics));
+
+  return h;
+}
+
+// Write all of buf at the given offset of fd.
+inline bool write_at(const int fd, const void* const buf, const size_t size, const uint64_t offset) {
+  const char* p = (const char*)buf;
+  size_t done = 0;
+
+  while (done < size) {
+    const ssize_t n = pwrite(fd, p + done, size - done, offset + done);
+
+    if (n <= 0) {
+      return false;
+    }
+
+    done += n;
+  }
+
+  return true;
+}
+
+// Write a snapshot of the given simulations. It goes to a temporary file
+// first and is renamed into place, so a crash mid-write never leaves a torn
+// checkpoint behind.
+inline bool snapshot_write(const std::string& path, const simulation* const sims, const size_t instances,
+                           const statistics& stats, const uint64_t tick) {
+  const snapshot_header h = snapshot_layout(instances, tick);
+  const std::string tmp_path = path + ".tmp";
+
+  const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0) {
+    std::cerr << "could not create " << tmp_path << ": " << strerror(errno) << '\n';
+    return false;
+  }
+
+  // The simulations are already laid out as the file wants them, so they go
+  // out in a single write.
+  bool ok = ftruncate(fd, h.file_size) == 0
+         && write_at(fd, &h, sizeof(h), 0)
+         && write_at(fd, sims, instances * sizeof(simulation), h.simulations_offset)
+         && write_at(fd, &stats, sizeof(stats), h.statistics_offset);
+
+  ok = close(fd) == 0 && ok;
+
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "could not write snapshot " << path << ": " << strerror(errno) << '\n';
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// A snapshot mapped into memory. The accessors point straight into the
+// mapping, which is private: writes through them change this process's copy
+// of a page and never the file.
+class snapshot_map {
+public:
+  snapshot_map() = default;
+
+  ~snapshot_map() {
+    if (data) {
+      munmap(data, size);
+    }
+  }
+
+  snapshot_map(const snapshot_map&) = delete;
+  snapshot_map& operator=(const snapshot_map&) = delete;
+
+  bool open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      std::cerr << "could not open " << path << ": " << strerror(errno) << '\n';
+      return false;
+    }
+
+    struct stat st { };
+    fstat(fd, &st);
+
+    size = st.st_size;
+    data = size >= sizeof(snapshot_header)
+         ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+         : MAP_FAILED;
+    close(fd);
+
+    if (data == MAP_FAILED) {
+      data = nullptr;
+      std::cerr << path << " is not a snapshot\n";
+      return false;
+    }
+
+    const snapshot_header& h = header();
+
+    if (memcmp(h.magic, snapshot_magic, sizeof(h.magic)) || h.version != snapshot_version) {
+      std::cerr << path << " is not a version " << snapshot_version << " snapshot\n";
+      return false;
+    }
+
+    // The layout is worked out from the instance count, so that has to fit
+    // in the file before it's trusted with the arithmetic.
+    if (size < snapshot_simulations_offset
+        || h.instances > (size - snapshot_simulations_offset) / sizeof(simulation)) {
+      std::cerr << path << " is too short for the " << h.instances << " instances it claims\n";
+      return false;
+    }
+
+    const snapshot_header expected = snapshot_layout(h.instances, h.tick);
+
+    if (memcmp(&h, &expected, sizeof(h)) || h.file_size > size) {
+      std::cerr << path << " was written by a build with a different layout\n";
+      return false;
+    }
+
+    valid = true;
+    return true;
+  }
+
+  bool ok() const { return valid; }
+
+  const snapshot_header& header() const { return *(const snapshot_header*)data; }
+  size_t instances() const { return header().instances; }
+  uint64_t tick() const { return header().tick; }
+
+  simulation* simulations() { return (simulation*)at(header().simulations_offset); }
+  const statistics& stats() const { return *(const statistics*)at(header().statistics_offset); }
+
+private:
+  char* at(const uint64_t offset) const { return (char*)data + offset; }
+
+  void* data = nullptr;
+  size_t size = 0;
+  bool valid = false;
+};
+
+/* Action logs */
+
+const uint32_t action_log_version = 1;
+
+const char action_log_magic[8] = { 'G', 'A', 'M', 'E', 'A', 'C', 'T', 'S' };
+
+struct action_log_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t world_size;
+  uint32_t agent_size;
+  uint32_t reserved;
+  uint64_t ticks;
+};
+
+struct action_log {
+  // The world and agent as the life began.
+  std::unique_ptr<world> start_world { new world };
+  agent start_agent;
+
+  // Two actions per byte, low nibble first, each stored as the index of its
+  // bit in agent::action.
+  std::vector<uint8_t> packed;
+  uint64_t ticks = 0;
+};
+
+inline void action_log_begin(action_log& log, const world& w, const agent& a) {
+  *log.start_world = w;
+  log.start_agent = a;
+  log.packed.clear();
+  log.ticks = 0;
+}
+
+inline void action_log_push(action_log& log, const agent::action act) {
+  const uint8_t code = __builtin_ctz(act);
+
+  if (log.ticks % 2 == 0) {
+    log.packed.push_back(code);
+  } else {
+    log.packed.back() |= code << 4;
+  }
+
+  ++log.ticks;
+}
+
+inline agent::action action_log_get(const action_log& log, const uint64_t tick) {
+  const uint8_t code = (log.packed[tick / 2] >> (tick % 2 * 4)) & 0xf;
+
+  return (agent::action)(1u << code);
+}
+
+inline bool action_log_write(const std::string& path, const action_log& log) {
+  action_log_header h;
+  memset(&h, 0, sizeof(h));
+
+  memcpy(h.magic, action_log_magic, sizeof(h.magic));
+  h.version = action_log_version;
+  h.world_size = sizeof(world);
+  h.agent_size = sizeof(agent);
+  h.ticks = log.ticks;
+
+  const std::string tmp_path = path + ".tmp";
+  std::FILE* f = std::fopen(tmp_path.c_str(), "wb");
+
+  if (!f) {
+    std::cerr << "could not create " << tmp_path << ": " << strerror(errno) << '\n';
+    return false;
+  }
+
+  bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1
+         && std::fwrite(log.start_world.get(), sizeof(world), 1, f) == 1
+         && std::fwrite(&log.start_agent, sizeof(agent), 1, f) == 1
+         && std::fwrite(log.packed.data(), 1, log.packed.size(), f) == log.packed.size();
+
+  ok = std::fclose(f) == 0 && ok;
+
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "could not write action log " << path << '\n';
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+inline bool action_log_read(const std::string& path, action_log& log) {
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+
+  if (!f) {
+    std::cerr << "could not open " << path << ": " << strerror(errno) << '\n';
+    return false;
+  }
+
+  struct stat st { };
+  fstat(fileno(f), &st);
+
+  // The tick count sizes the buffer the actions are read into, so it has to
+  // fit in what's left of the file after the world and agent.
+  const uint64_t size = st.st_size;
+  const uint64_t start_size = sizeof(action_log_header) + sizeof(world) + sizeof(agent);
+
+  action_log_header h;
+
+  bool ok = std::fread(&h, sizeof(h), 1, f) == 1
+         && !memcmp(h.magic, action_log_magic, sizeof(h.magic))
+         && h.version == action_log_version
+         && h.world_size == sizeof(world)
+         && h.agent_size == sizeof(agent)
+         && size >= start_size
+         && h.ticks - h.ticks / 2 <= size - start_size;
+
+  if (ok) {
+    log.ticks = h.ticks;
+    log.packed.resize((h.ticks + 1) / 2);
+
+    ok = std::fread(log.start_world.get(), sizeof(world), 1, f) == 1
+      && std::fread(&log.start_agent, sizeof(agent), 1, f) == 1
+      && std::fread(log.packed.data(), 1, log.packed.size(), f) == log.packed.size();
+  }
+
+  std::fclose(f);
+
+  if (!ok) {
+    std::cerr << path << " is not a compatible action log\n";
+  }
+
+  return ok;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+// A small work-stealing thread pool. Every participant (the background workers
+// plus the thread that calls parallel_for) owns a deque of tasks; it pops work
+// off the back of its own deque and, once that runs dry, steals from the front
+// of the others'. The calling thread always takes part, so a pool of one
+// thread runs everything inline.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool {
+public:
+  // threads is the total number of participants, including the caller of
+  // parallel_for; 0 means one per hardware thread.
+  explicit thread_pool(unsigned threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < threads; ++i) {
+      queues.emplace_back(new task_queue);
+    }
+
+    // Participant 0 is whoever calls parallel_for.
+    for (unsigned i = 1; i < threads; ++i) {
+      workers.emplace_back([this, i]() { worker_loop(i); });
+    }
+  }
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  unsigned size() const {
+    return (unsigned)queues.size();
+  }
+
+  // Call fn(begin, end, participant) over [0, count) split into chunks of at
+  // most grain items, and return once every chunk has run. participant is in
+  // [0, size()) and is unique among the chunks running at any one time, so it
+  // can index per-thread scratch space without locking.
+  template<typename F>
+  void parallel_for(const size_t count, size_t grain, F&& fn) {
+    if (count == 0) {
+      return;
+    }
+
+    grain = std::max<size_t>(grain, 1);
+
+    const size_t chunks = (count + grain - 1) / grain;
+    std::atomic<size_t> remaining(chunks);
+
+    for (size_t c = 0; c < chunks; ++c) {
+      const size_t begin = c * grain;
+      const size_t end = std::min(count, begin + grain);
+
+      push(c % queues.size(), [&fn, &remaining, begin, end](unsigned participant) {
+        fn(begin, end, participant);
+        remaining.fetch_sub(1, std::memory_order_release);
+      });
+    }
+
+    wake.notify_all();
+
+    // Help out until our chunks are done. Once the deques are empty the last
+    // few chunks are still running elsewhere, so just yield until they finish.
+    while (remaining.load(std::memory_order_acquire) != 0) {
+      task t;
+
+      if (take(0, t)) {
+        t(0);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  using task = std::function<void(unsigned)>;
+
+  struct task_queue {
+    std::mutex m;
+    std::deque<task> tasks;
+  };
+
+  void push(const size_t participant, task t) {
+    {
+      std::lock_guard<std::mutex> lock(queues[participant]->m);
+      queues[participant]->tasks.push_back(std::move(t));
+    }
+
+    // Bumped under the sleep mutex so a worker can't miss the wakeup between
+    // checking for work and going to sleep.
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    ++queued;
+  }
+
+  // Pop from our own deque first, then try to steal from everyone else's.
+  bool take(const unsigned participant, task& out) {
+    const size_t n = queues.size();
+
+    for (size_t i = 0; i < n; ++i) {
+      task_queue& q = *queues[(participant + i) % n];
+      std::lock_guard<std::mutex> lock(q.m);
+
+      if (q.tasks.empty()) {
+        continue;
+      }
+
+      if (i == 0) {
+        out = std::move(q.tasks.back());
+        q.tasks.pop_back();
+      } else {
+        out = std::move(q.tasks.front());
+        q.tasks.pop_front();
+      }
+
+      --queued;
+      return true;
+    }
+
+    return false;
+  }
+
+  void worker_loop(const unsigned participant) {
+    while (true) {
+      task t;
+
+      if (take(participant, t)) {
+        t(participant);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      wake.wait(lock, [this]() { return stopping || queued.load() != 0; });
+
+      if (stopping) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<task_queue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  std::atomic<size_t> queued { 0 };
+  bool stopping = false;
+};
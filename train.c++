@@ -0,0 +1,112 @@
+
+// Evolves perceptron nets with the genetic trainer and reports every
+// generation as a line of CSV on stdout. Build with something like
+//
+//   g++ -std=c++17 -O2 -pthread train.c++ -o train
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "trainer.h"
+
+namespace {
+
+struct options {
+  trainer_config config;
+  int generations = 50;
+  unsigned threads = 0;
+};
+
+void usage(const char* prog) {
+  const trainer_config defaults;
+
+  std::cout << "usage: " << prog << " [options]\n"
+            << "  --generations N     generations to run (default 50)\n"
+            << "  --population N      genomes per generation (default " << defaults.population << ")\n"
+            << "  --episodes N        episodes per genome per generation (default " << defaults.episodes << ")\n"
+            << "  --max-ticks N       longest an episode may last (default " << defaults.max_ticks << ")\n"
+            << "  --mutation F        per-bit mutation probability (default " << defaults.mutation_rate << ")\n"
+            << "  --threads N         worker threads, 0 for one per core (default 0)\n"
+            << "  --seed N            master seed (default " << defaults.seed << ")\n";
+}
+
+bool parse_options(int argc, char* args[], options& opts) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = args[i];
+
+    if (i + 1 >= argc) {
+      return false;
+    }
+
+    const char* value = args[++i];
+
+    if (!strcmp(arg, "--generations")) {
+      opts.generations = std::atoi(value);
+    } else if (!strcmp(arg, "--population")) {
+      opts.config.population = std::strtoull(value, nullptr, 10);
+    } else if (!strcmp(arg, "--episodes")) {
+      opts.config.episodes = std::atoi(value);
+    } else if (!strcmp(arg, "--max-ticks")) {
+      opts.config.max_ticks = std::atoi(value);
+    } else if (!strcmp(arg, "--mutation")) {
+      opts.config.mutation_rate = std::atof(value);
+    } else if (!strcmp(arg, "--threads")) {
+      opts.threads = std::atoi(value);
+    } else if (!strcmp(arg, "--seed")) {
+      opts.config.seed = std::strtoull(value, nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}
+
+int main(int argc, char* args[]) {
+  options opts;
+
+  if (!parse_options(argc, args, opts)) {
+    usage(args[0]);
+    return 1;
+  }
+
+  thread_pool pool(opts.threads);
+  trainer t;
+
+  trainer_init(t, opts.config);
+
+  std::printf("generation,best_fitness,mean_fitness,ticks,longest_life,most_fruit_eaten,"
+              "deaths_by_cold,deaths_by_drowning,deaths_by_cactus,deaths_by_exhaustion,deaths_by_gluttony,"
+              "seconds,generations_per_second\n");
+
+  double total_seconds = 0;
+
+  for (int g = 0; g < opts.generations; ++g) {
+    const generation_report r = trainer_step(t, pool);
+    const statistics& s = r.stats;
+
+    total_seconds += r.seconds;
+
+    std::printf("%d,%.2f,%.2f,%llu,%d,%d,%llu,%llu,%llu,%llu,%llu,%.3f,%.3f\n",
+                r.generation, r.best_fitness, r.mean_fitness, (unsigned long long)s.ticks,
+                s.longest_life, s.most_fruit_eaten,
+                (unsigned long long)s.deaths_by_cold, (unsigned long long)s.deaths_by_drowning,
+                (unsigned long long)s.deaths_by_cactus, (unsigned long long)s.deaths_by_exhaustion,
+                (unsigned long long)s.deaths_by_gluttony,
+                r.seconds, (g + 1) / total_seconds);
+    std::fflush(stdout);
+  }
+
+  std::fprintf(stderr, "best fitness %.2f\n", t.best_fitness);
+
+  for (size_t n = 0; n < t.best.layer1.layersize; ++n) {
+    std::fprintf(stderr, "  node %zu: and %04x xor %04x threshold %d\n", n,
+                 t.best.layer1.and_mask[n], t.best.layer1.xor_mask[n], t.best.layer1.threshold[n]);
+  }
+
+  return 0;
+}
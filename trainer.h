@@ -0,0 +1,281 @@
+#pragma once
+
+// A genetic trainer for perceptron nets. It keeps a population of genomes
+// (the and_mask, xor_mask and threshold of every node), lets each of them live
+// out a few episodes in parallel, and breeds the next generation from the
+// fittest with tournament selection, uniform crossover and bit-flip mutation.
+//
+// An episode's fitness is how long the agent lived plus a bonus for every
+// fruit it ate. Every episode runs until the agent dies or reaches
+// max_ticks, and genomes are bred from that final fitness: how an episode
+// started says little about how it ends, as an agent that has been scraping
+// by can still walk into a field of fruit. Agents starve within a few hundred
+// ticks unless they keep eating, so running every episode out costs little.
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "sim.h"
+#include "thread_pool.h"
+
+using genome = perceptron_agent::perceptron_nn;
+
+struct trainer_config {
+  size_t population = 256;
+
+  // Episodes every genome lives through per generation. All genomes of a
+  // generation face the same worlds, so they are compared fairly.
+  int episodes = 2;
+
+  // An episode that gets this far ends even though the agent is alive.
+  int max_ticks = 4000;
+
+  double fruit_weight = 25;
+
+  // How many of the best genomes go into the next generation unchanged.
+  size_t elite = 4;
+  int tournament_size = 4;
+
+  double crossover_rate = 0.7;
+  // Chance for each mask bit to flip, and for each threshold to move by one.
+  double mutation_rate = 1.0 / 128;
+  double threshold_mutation_rate = 1.0 / 32;
+
+  uint64_t seed = 1;
+};
+
+struct generation_report {
+  int generation = 0;
+
+  double best_fitness = 0;
+  double mean_fitness = 0;
+
+  // Merged over every episode of the generation.
+  statistics stats;
+
+  double seconds = 0;
+};
+
+struct trainer {
+  trainer_config config;
+
+  std::vector<genome> population;
+  std::vector<double> fitness;
+
+  // config.episodes per genome, genome-major.
+  std::vector<simulation> episodes;
+
+  // One block of statistics per pool participant.
+  std::vector<participant_statistics> per_thread;
+
+  // The fittest genome seen in any generation so far.
+  genome best;
+  double best_fitness = -1;
+
+  rng rand;
+  int generation = 0;
+};
+
+inline void trainer_init(trainer& t, const trainer_config& config) {
+  t.config = config;
+  t.config.population = std::max<size_t>(config.population, 2);
+  t.config.episodes = std::max(config.episodes, 1);
+  t.config.elite = std::min(config.elite, t.config.population);
+
+  t.rand = rng(rng_stream_seed(config.seed, 0));
+  t.generation = 0;
+  t.best_fitness = -1;
+
+  t.population.resize(t.config.population);
+  t.fitness.assign(t.config.population, 0);
+  t.episodes.resize(t.config.population * t.config.episodes);
+
+  for (auto& g : t.population) {
+    randomize_nn(g, t.rand);
+  }
+}
+
+inline double episode_fitness(const trainer& t, const agent& a) {
+  return a.ticks_alive + t.config.fruit_weight * a.total_fruit_eaten;
+}
+
+// Run an episode until the agent dies or max_ticks. This is simulation_think
+// and runtick, except that vision is carried over from the tick before when
+// the agent stood still: it doesn't turn then, and the only tile the tick
+// changes is the one it stands on, which it doesn't see.
+inline void run_episode(const trainer& t, simulation& sim, statistics& s) {
+  bool alive = true;
+  bool moved = true;
+  input_t vision = 0;
+
+  while (alive && sim.a.ticks_alive < t.config.max_ticks) {
+    if (moved) {
+      vision = calculate_vision_input(sim.w, sim.a);
+    }
+
+    const agent::action act = evaluate_nn(sim.a.nn, calculate_senses(sim.w, sim.a) | vision, sim.a.rand);
+
+    moved = act != agent::action_nothing;
+    alive = runtick(s, sim.w, sim.a, act);
+  }
+}
+
+inline double genome_fitness(const trainer& t, const size_t g) {
+  double total = 0;
+
+  for (int e = 0; e < t.config.episodes; ++e) {
+    total += episode_fitness(t, t.episodes[g * t.config.episodes + e].a);
+  }
+
+  return total / t.config.episodes;
+}
+
+// Work out the fitness of every genome in the population.
+inline void trainer_evaluate(trainer& t, thread_pool& pool) {
+  const size_t n = t.population.size();
+
+  for (size_t g = 0; g < n; ++g) {
+    for (int e = 0; e < t.config.episodes; ++e) {
+      simulation& sim = t.episodes[g * t.config.episodes + e];
+
+      // The same world and the same luck for every genome's e'th episode.
+      sim.rand = rng(rng_stream_seed(t.config.seed, 1 + (uint64_t)t.generation * t.config.episodes + e));
+      simulation_reset(sim);
+      sim.a.nn = t.population[g];
+    }
+  }
+
+  // One episode at a time: they take anything from a few dozen ticks to
+  // max_ticks, so larger chunks would balance badly.
+  pool.parallel_for(t.episodes.size(), 1, [&t](size_t begin, size_t end, unsigned participant) {
+    for (size_t i = begin; i < end; ++i) {
+      run_episode(t, t.episodes[i], t.per_thread[participant].stats);
+    }
+  });
+
+  for (size_t g = 0; g < n; ++g) {
+    t.fitness[g] = genome_fitness(t, g);
+  }
+}
+
+inline size_t tournament_select(trainer& t) {
+  size_t best = t.rand.below(t.population.size());
+
+  for (int i = 1; i < t.config.tournament_size; ++i) {
+    const size_t other = t.rand.below(t.population.size());
+
+    if (t.fitness[other] > t.fitness[best]) {
+      best = other;
+    }
+  }
+
+  return best;
+}
+
+// True with the given probability.
+inline bool chance(rng& rand, const double p) {
+  return (rand.next() >> 11) * (1.0 / (1ull << 53)) < p;
+}
+
+inline void mutate(trainer& t, genome& g) {
+  auto& layer = g.layer1;
+
+  for (size_t n = 0; n < layer.layersize; ++n) {
+    for (int b = 0; b < 16; ++b) {
+      if (chance(t.rand, t.config.mutation_rate)) {
+        layer.and_mask[n] ^= bit(b);
+      }
+      if (chance(t.rand, t.config.mutation_rate)) {
+        layer.xor_mask[n] ^= bit(b);
+      }
+    }
+
+    if (chance(t.rand, t.config.threshold_mutation_rate)) {
+      layer.threshold[n] += (t.rand.next() & 1) ? 1 : -1;
+      layer.threshold[n] = std::min(std::max(layer.threshold[n], 0), input_mask::num_active_inputs);
+    }
+  }
+}
+
+// Replace the population with its offspring.
+inline void trainer_breed(trainer& t) {
+  const size_t n = t.population.size();
+
+  std::vector<size_t> order(n);
+  for (size_t g = 0; g < n; ++g) {
+    order[g] = g;
+  }
+
+  std::sort(order.begin(), order.end(), [&t](const size_t l, const size_t r) {
+    return t.fitness[l] > t.fitness[r] || (t.fitness[l] == t.fitness[r] && l < r);
+  });
+
+  std::vector<genome> next;
+  next.reserve(n);
+
+  for (size_t i = 0; i < t.config.elite; ++i) {
+    next.push_back(t.population[order[i]]);
+  }
+
+  while (next.size() < n) {
+    genome child = t.population[tournament_select(t)];
+
+    if (chance(t.rand, t.config.crossover_rate)) {
+      // Uniform crossover a whole node at a time, so that each node's masks
+      // and threshold stay together.
+      const genome& other = t.population[tournament_select(t)];
+
+      for (size_t node = 0; node < child.layer1.layersize; ++node) {
+        if (t.rand.next() & 1) {
+          child.layer1.and_mask[node] = other.layer1.and_mask[node];
+          child.layer1.xor_mask[node] = other.layer1.xor_mask[node];
+          child.layer1.threshold[node] = other.layer1.threshold[node];
+        }
+      }
+    }
+
+    mutate(t, child);
+    next.push_back(child);
+  }
+
+  t.population = std::move(next);
+}
+
+// Evaluate the current generation, report on it and breed the next one.
+inline generation_report trainer_step(trainer& t, thread_pool& pool) {
+  const auto start = std::chrono::steady_clock::now();
+
+  t.per_thread.assign(pool.size(), participant_statistics());
+
+  generation_report report;
+  report.generation = t.generation;
+
+  trainer_evaluate(t, pool);
+
+  for (const auto& p : t.per_thread) {
+    statistics_merge(report.stats, p.stats);
+  }
+
+  double total = 0;
+  report.best_fitness = t.fitness[0];
+
+  for (size_t g = 0; g < t.fitness.size(); ++g) {
+    total += t.fitness[g];
+    report.best_fitness = std::max(report.best_fitness, t.fitness[g]);
+
+    if (t.fitness[g] > t.best_fitness) {
+      t.best_fitness = t.fitness[g];
+      t.best = t.population[g];
+    }
+  }
+
+  report.mean_fitness = total / t.fitness.size();
+
+  trainer_breed(t);
+  ++t.generation;
+
+  report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return report;
+}